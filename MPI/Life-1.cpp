@@ -5,16 +5,43 @@
 #include <fstream>
 #include <string>
 #include <iostream>
+#include <algorithm>
+#include "board_memory.h"
 
 enum TAG {UP, DOWN, STATE, PARAM, TIME, STATUS, ITERATION, HEIGHT, WIDTH};
 
 enum state {WAIT, RUN, STOP, QUIT};
 
-void set_random_table(std::vector<std::vector<char> >& table, int height, int width) {
-    table.resize(height);
-    for (int i = 0; i < height; ++i) {
-        table[i].resize(width);
+// Board with one char per cell in one block of memory, every row starts on a
+// cache line: the row pitch is the width rounded up to CACHE_LINE_BYTES.
+struct char_table {
+    int height;
+    int width;
+    size_t pitch;
+    std::vector<char, board_allocator<char> > cells;
+
+    char_table() : height(0), width(0), pitch(0) {}
+
+    char *operator[](int i) {
+        return &cells[i * pitch];
     }
+
+    const char *operator[](int i) const {
+        return &cells[i * pitch];
+    }
+};
+
+void resize_table(char_table& table, int height, int width) {
+    table.height = height;
+    table.width = width;
+    table.pitch = (width + CACHE_LINE_BYTES - 1) / CACHE_LINE_BYTES * CACHE_LINE_BYTES;
+    table.cells.clear();
+    table.cells.resize(height * table.pitch);
+    std::fill(table.cells.begin(), table.cells.end(), 0); // the first touch, by the rank that computes the rows
+}
+
+void set_random_table(char_table& table, int height, int width) {
+    resize_table(table, height, width);
     srand(0);
     for (int i = 0; i < height; ++i) {
         for (int j = 0; j < width; ++j) {
@@ -23,59 +50,48 @@ void set_random_table(std::vector<std::vector<char> >& table, int height, int wi
     }
 }
 
-void set_csv_table(std::vector<std::vector<char> >& table, const char *csv_file) {
+// The first pass counts the rows and takes the width from the first one, the
+// second one parses the rows straight into the table.
+void set_csv_table(char_table& table, const char *csv_file) {
     std::ifstream in(csv_file);
     std::string line;
     int height = 0;
-    int width;
+    int width = 0;
     while(std::getline(in, line)) {
+        if (height == 0) {
+            width = (line.size() + 1) / 2;
+        }
         height++;
-        std::vector<char> row;
-        if (height == 1) {
-            width = 0;
-            for (int i = 0; i < line.size(); ++i) {
-                if (i % 2 == 0) {
-                    if (line[i] == '0') {
-                        width++;
-                        row.push_back(0);
-                    } else if (line[i] == '1') {
-                        width++;
-                        row.push_back(1);
-                    } else {
-                        std::cerr << "Incorrect CSV field" << std::endl;
-                        exit(1);
-                    }
-                } else if (line[i] != ',') {
+    }
+    in.clear();
+    in.seekg(0);
+    resize_table(table, height, width);
+    for (int j = 0; j < height && std::getline(in, line); ++j) {
+        char *row = table[j];
+        if (j > 0 && line.size() + 1 < 2 * width) {
+            std::cerr << "Incorrect CSV field" << std::endl;
+            exit(1);
+        }
+        int end = j == 0 ? line.size() : 2 * width - 1; // the first row sets the width
+        for (int i = 0; i < end; ++i) {
+            if (i % 2 == 0) {
+                if (line[i] == '0') {
+                    row[i / 2] = 0;
+                } else if (line[i] == '1') {
+                    row[i / 2] = 1;
+                } else {
                     std::cerr << "Incorrect CSV field" << std::endl;
                     exit(1);
                 }
-            }
-        } else {
-            if (line.size() + 1 < 2 * width) {
+            } else if (line[i] != ',') {
                 std::cerr << "Incorrect CSV field" << std::endl;
                 exit(1);
             }
-            for (int i = 0; i < 2 * width - 1; ++i) {
-                if (i % 2 == 0) {
-                    if (line[i] == '0') {
-                        row.push_back(0);
-                    } else if (line[i] == '1') {
-                        row.push_back(1);
-                    } else {
-                        std::cerr << "Incorrect CSV field" << std::endl;
-                        exit(1);
-                    }
-                } else if (line[i] != ',') {
-                    std::cerr << "Incorrect CSV field" << std::endl;
-                    exit(1);
-                }
-            }
         }
-        table.push_back(row);
     }
 }
 
-size_t calc_alive_neighbour_count(const std::vector<std::vector<char> >& table, int i, int j, int width) {
+size_t calc_alive_neighbour_count(const char_table& table, int i, int j, int width) {
     size_t alive_neighbour_count = 0;
     alive_neighbour_count += table[i - 1][j ? j - 1 : width - 1];
     alive_neighbour_count += table[i - 1][j];
@@ -88,13 +104,13 @@ size_t calc_alive_neighbour_count(const std::vector<std::vector<char> >& table,
     return alive_neighbour_count;
 }
 
-void send_borders(std::vector<std::vector<char> >& table, int rank, int size, int height, int width) { //      MPI,     ,        
+void send_borders(char_table& table, int rank, int size, int height, int width) { //      MPI,     ,        
     MPI_Status status;
     int up_rank  = (rank == 1 ? size - 1 : rank - 1); //  
     int down_rank = (rank == size - 1 ? 1 : rank + 1);
     if (size > 2) {
-        MPI_Sendrecv(&table[1].front(), width, MPI_CHAR, up_rank, UP, &table[height - 1].front(), width, MPI_CHAR, down_rank, UP, MPI_COMM_WORLD, &status); //    
-        MPI_Sendrecv(&table[height - 2].front(), width, MPI_CHAR, down_rank, DOWN, &table[0].front(), width, MPI_CHAR, up_rank, DOWN, MPI_COMM_WORLD, &status);
+        MPI_Sendrecv(table[1], width, MPI_CHAR, up_rank, UP, table[height - 1], width, MPI_CHAR, down_rank, UP, MPI_COMM_WORLD, &status); //    
+        MPI_Sendrecv(table[height - 2], width, MPI_CHAR, down_rank, DOWN, table[0], width, MPI_CHAR, up_rank, DOWN, MPI_COMM_WORLD, &status);
     } else {
         for (int j = 0; j < width; ++j) {
             table[height - 1][j] = table[1][j];
@@ -127,7 +143,7 @@ void send_time(state st, int size) {
     }
 }
 
-void print_status(std::vector<std::vector<char> >& table, int height, int width, int size) { //    
+void print_status(char_table& table, int height, int width, int size) { //    
     int iteration;
     MPI_Status status;
     MPI_Recv(&iteration, 1, MPI_INT, 1, ITERATION, MPI_COMM_WORLD, &status); //   
@@ -141,7 +157,7 @@ void print_status(std::vector<std::vector<char> >& table, int height, int width,
             start_pos += height % (size - 1);
         }
         for (int j = start_pos; j < start_pos + block_size; ++j) {
-            MPI_Recv(&table[j].front(), width, MPI_CHAR, i + 1, j - start_pos, MPI_COMM_WORLD, &status);
+            MPI_Recv(table[j], width, MPI_CHAR, i + 1, j - start_pos, MPI_COMM_WORLD, &status);
         }
     }
     std::cout << "Iteration: " << iteration << std::endl; //    
@@ -160,7 +176,7 @@ void print_iteration() { // 
     std::cout << "Iteration: " << iteration << std::endl;
 }
 
-void iterate(std::vector<std::vector<char> >& table, std::vector<std::vector<char> >& next_table, int height, int width) { //   
+void iterate(char_table& table, char_table& next_table, int height, int width) { //   
     for(int i = 1; i < height - 1; ++i) {
         for(int j = 0; j < width; ++j) {
             size_t alive_neighbour_count = calc_alive_neighbour_count(table, i, j, width);
@@ -181,7 +197,7 @@ void iterate(std::vector<std::vector<char> >& table, std::vector<std::vector<cha
     }
 }
 
-void send_table(std::vector<std::vector<char> >& table, int height, int width, int size) { //    - 
+void send_table(char_table& table, int height, int width, int size) { //    - 
     for(int i = 0; i < size - 1; ++i) { //     
         int start_pos = height / (size - 1) * i; //   
         int block_size = height / (size - 1); //   
@@ -194,28 +210,25 @@ void send_table(std::vector<std::vector<char> >& table, int height, int width, i
         MPI_Send(&block_size, 1, MPI_INT, i + 1, HEIGHT, MPI_COMM_WORLD);  //     
         MPI_Send(&width, 1, MPI_INT, i + 1, WIDTH, MPI_COMM_WORLD); //     
         for (int j = start_pos; j < start_pos + block_size; ++j) {
-            MPI_Send(&table[j].front(), table[j].size(), MPI_CHAR, i + 1, j, MPI_COMM_WORLD); //     
+            MPI_Send(table[j], width, MPI_CHAR, i + 1, j, MPI_COMM_WORLD); //     
         }
     }
 }
 
-void init_table(std::vector<std::vector<char> >& table, int& height, int& width, int size) { //      
+void init_table(char_table& table, int& height, int& width, int size) { //      
     MPI_Status status;
     MPI_Recv(&height, 1, MPI_INT, 0, HEIGHT, MPI_COMM_WORLD, &status); //    
     MPI_Recv(&width, 1, MPI_INT, 0, WIDTH, MPI_COMM_WORLD, &status);
     height += 2; //     -   
-    table.resize(height);
-    for(int i = 0; i < height; ++i) {
-        table[i].resize(width);
-    }
+    resize_table(table, height, width);
     for(int i = 1; i < height - 1; ++i) {
-        MPI_Recv(&table[i].front(), width, MPI_CHAR, 0, MPI_ANY_TAG, MPI_COMM_WORLD, &status); //    
+        MPI_Recv(table[i], width, MPI_CHAR, 0, MPI_ANY_TAG, MPI_COMM_WORLD, &status); //    
     }
 }
 
 void master(int size) 
 {
-    std::vector<std::vector<char> > table;
+    char_table table;
     int width, height;
     bool started = false; //   ,    
     state st = WAIT;
@@ -231,12 +244,12 @@ void master(int size)
             std::cin >> info;
             if (info.find(".csv") != std::string::npos) { //    
                 set_csv_table(table, info.c_str());
-                height = table.size();
+                height = table.height;
                 if (height == 0) {
                     std::cerr << "Empty table found in csv file. Try again." << std::endl;
                     continue;
                 }
-                width = table[0].size();
+                width = table.width;
             } else { //   
                 int m = 0;
                 for (int i = 0; i < info.size(); ++i) {
@@ -285,13 +298,10 @@ void worker(int rank, int size) {
     int iteration = 0; //  
     int it_count = 0; //  
     double start_time, stop_time; // ,   (?)
-    std::vector<std::vector<char> > odd_table;
-    std::vector<std::vector<char> > even_table;
+    char_table odd_table;
+    char_table even_table;
     init_table(even_table, height, width, size); //       
-    odd_table.resize(height);
-    for(int i = 0; i < height; ++i) {
-        odd_table[i].resize(width);
-    }
+    resize_table(odd_table, height, width);
     MPI_Request request;
     MPI_Status status;
     int message;
@@ -337,9 +347,9 @@ void worker(int rank, int size) {
                 }
                 for(int i = 1; i < height - 1; ++i) { //   
                     if (iteration % 2 == 0) {
-                        MPI_Send(&even_table[i].front(), even_table[i].size(), MPI_CHAR, 0, i - 1, MPI_COMM_WORLD);
+                        MPI_Send(even_table[i], width, MPI_CHAR, 0, i - 1, MPI_COMM_WORLD);
                     } else {
-                        MPI_Send(&odd_table[i].front(), odd_table[i].size(), MPI_CHAR, 0, i - 1, MPI_COMM_WORLD);
+                        MPI_Send(odd_table[i], width, MPI_CHAR, 0, i - 1, MPI_COMM_WORLD);
                     }
                 }
             } else if (tag == ITERATION) { //    ,  (???)
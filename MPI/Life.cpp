@@ -1,363 +1,3507 @@
 #include <mpi.h>
 #include <vector>
 #include <stdlib.h>
-#include <unistd.h> 
+#include <stdint.h>
+#include <stdio.h>
+#include <float.h>
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <fstream>
 #include <string>
 #include <iostream>
+#include <algorithm>
+#include <unordered_map>
+#include <deque>
+#include <sstream>
+#include "board_memory.h"
+#include <thread>
+#include <mutex>
+#include <condition_variable>
 
-enum TAG {UP, DOWN};
+enum TAG {UP, DOWN, LEFT, RIGHT, UP_LEFT, UP_RIGHT, DOWN_LEFT, DOWN_RIGHT, BLOCK, AGE_UP, AGE_DOWN};
 
-enum msg {WAIT, RUN, STOP, QUIT, PARAM, STATUS, ITERATION, TIME};
+enum msg {WAIT, RUN, STOP, QUIT, PARAM, STATUS, ITERATION, TIME, SAVE, LOAD, STATS, START};
 
-void set_random_table(std::vector<char>& table, int height, int width) {
-    table.resize(height * width);
-    for (int i = 0; i < height * width; ++i) {
-        table[i] = rand() % 2;
+// Board with one bit per cell. Every row is padded to a whole number of 64-bit
+// words, bit j % 64 of word j / 64 holds cell j, the padding bits are kept zero.
+// The cells beyond the ends of row i are kept aside: bit west_bit of west[i] is
+// the cell west of the row, bit 0 of east[i] the cell east of it.
+// On workers the first and the last halo rows are ghost rows.
+// The rows follow each other with no gap, as they go into the messages and
+// the checkpoint files, in memory from board_memory.h.
+struct bit_table {
+    int height;
+    int width;
+    int row_words;
+    std::vector<uint64_t, board_allocator<uint64_t> > words;
+    std::vector<uint64_t, board_allocator<uint64_t> > west;
+    std::vector<uint64_t, board_allocator<uint64_t> > east;
+    int west_bit;
+    int halo;
+    std::vector<uint8_t, board_allocator<uint8_t> > age; // the state of every cell of a Generations rule, 0 unless it is dying
+};
+
+int thread_count = 1; // threads sharing iterate() inside one rank, set by --threads
+
+int calc_row_words(int width) {
+    return (width + 63) / 64;
+}
+
+// Fills rows of size cells each with those of from, or with zeros without
+// one. Every thread fills the rows iterate() gives it, so their pages are first
+// touched on the NUMA node of the thread that computes them.
+template <typename T>
+void fill_rows(T *cells, const T *from, int rows, size_t size) {
+#pragma omp parallel for num_threads(thread_count) schedule(static, 1)
+    for (int block = 0; block < thread_count; ++block) {
+        size_t begin = (long long)rows * block / thread_count * size;
+        size_t end = (long long)rows * (block + 1) / thread_count * size;
+        if (from) {
+            std::copy(from + begin, from + end, cells + begin);
+        } else {
+            std::fill(cells + begin, cells + end, 0);
+        }
+    }
+}
+
+void resize_table(bit_table& table, int height, int width) {
+    table.height = height;
+    table.width = width;
+    table.row_words = calc_row_words(width);
+    table.words.clear(); // the cells are filled below, not by resize()
+    table.words.resize((size_t)height * table.row_words);
+    table.west.clear();
+    table.west.resize(height);
+    table.east.clear();
+    table.east.resize(height);
+    fill_rows(table.words.data(), (const uint64_t *)0, height, table.row_words);
+    fill_rows(table.west.data(), (const uint64_t *)0, height, 1);
+    fill_rows(table.east.data(), (const uint64_t *)0, height, 1);
+    table.west_bit = (width - 1) & 63;
+    table.halo = 1;
+    table.age.clear();
+}
+
+// table = from, with the pages placed as resize_table() places them.
+void copy_table(bit_table& table, const bit_table& from) {
+    resize_table(table, from.height, from.width);
+    fill_rows(table.words.data(), from.words.data(), from.height, from.row_words);
+    fill_rows(table.west.data(), from.west.data(), from.height, 1);
+    fill_rows(table.east.data(), from.east.data(), from.height, 1);
+    table.west_bit = from.west_bit;
+    table.halo = from.halo;
+    table.age.resize(from.age.size());
+    if (!from.age.empty()) {
+        fill_rows(table.age.data(), from.age.data(), from.height, from.width);
+    }
+}
+
+inline uint64_t *table_row(bit_table& table, int i) {
+    return &table.words[(size_t)i * table.row_words];
+}
+
+inline const uint64_t *table_row(const bit_table& table, int i) {
+    return &table.words[(size_t)i * table.row_words];
+}
+
+inline char get_cell(const bit_table& table, int i, int j) {
+    return (table_row(table, i)[j >> 6] >> (j & 63)) & 1;
+}
+
+inline void set_cell(bit_table& table, int i, int j, char value) {
+    uint64_t bit = (uint64_t)1 << (j & 63);
+    if (value) {
+        table_row(table, i)[j >> 6] |= bit;
+    } else {
+        table_row(table, i)[j >> 6] &= ~bit;
+    }
+}
+
+// Random board of START h w [density] [seed]. Cell (i, j) lives when lane j % 4
+// of the Philox4x32-10 block of counter (j / 4, i), keyed by the seed, is
+// below density * 2^32. The cell is a function of the seed and of its place
+// alone, so every rank makes up its own block and the board is the same for
+// any number of ranks.
+struct random_board {
+    int height;
+    int width;
+    double density;
+    unsigned long long seed;
+};
+
+inline void philox(uint32_t counter[4], uint32_t key0, uint32_t key1) {
+    for (int round = 0; round < 10; ++round) {
+        uint64_t product0 = (uint64_t)0xD2511F53 * counter[0];
+        uint64_t product1 = (uint64_t)0xCD9E8D57 * counter[2];
+        uint32_t x0 = (uint32_t)(product1 >> 32) ^ counter[1] ^ key0;
+        uint32_t x2 = (uint32_t)(product0 >> 32) ^ counter[3] ^ key1;
+        counter[0] = x0;
+        counter[1] = (uint32_t)product1;
+        counter[2] = x2;
+        counter[3] = (uint32_t)product0;
+        key0 += 0x9E3779B9;
+        key1 += 0xBB67AE85;
+    }
+}
+
+// Fills rows first..first+rows-1 of table, zero so far, with the cells of
+// the random board from row row_begin and column col_begin on, a multiple of 4.
+void fill_random_rows(bit_table& table, const random_board& r, int first, int rows, int row_begin, int col_begin) {
+    uint64_t threshold = r.density >= 1 ? (uint64_t)1 << 32 : (uint64_t)(std::max(r.density, 0.0) * 4294967296.0);
+#pragma omp parallel for num_threads(thread_count) schedule(static)
+    for (int i = 0; i < rows; ++i) {
+        uint64_t *row = table_row(table, first + i);
+        for (int j = 0; j < table.width; j += 4) {
+            uint32_t block[4] = {(uint32_t)((col_begin + j) >> 2), (uint32_t)(row_begin + i), 0, 0};
+            philox(block, (uint32_t)r.seed, (uint32_t)(r.seed >> 32));
+            for (int lane = 0; lane < 4 && j + lane < table.width; ++lane) {
+                row[(j + lane) >> 6] |= (uint64_t)(block[lane] < threshold) << ((j + lane) & 63);
+            }
+        }
+    }
+}
+
+void set_random_table(bit_table& table, const random_board& r) {
+    resize_table(table, r.height, r.width);
+    fill_random_rows(table, r, 0, r.height, 0, 0);
+}
+
+// Formats of the board files given to START, told apart by the extension:
+// 0 and 1 separated by commas, plaintext with . and O and ! comment lines, and
+// run-length encoded RLE.
+enum board_format {NO_BOARD, CSV_BOARD, PLAINTEXT_BOARD, RLE_BOARD, CHECKPOINT_BOARD};
+
+// Board file mapped into memory. Rows of CSV and plaintext are lines, RLE runs
+// follow the header line in any layout.
+struct board_file {
+    board_format format;
+    const char *data;
+    size_t size;
+    size_t body; // offset of the first run of an RLE file
+    int height;
+    int width;
+};
+
+board_format board_format_of(const std::string& name) {
+    size_t dot = name.rfind('.');
+    std::string extension = dot == std::string::npos ? "" : name.substr(dot);
+    if (extension == ".csv") {
+        return CSV_BOARD;
+    } else if (extension == ".cells" || extension == ".txt") {
+        return PLAINTEXT_BOARD;
+    } else if (extension == ".rle") {
+        return RLE_BOARD;
+    }
+    return NO_BOARD;
+}
+
+void board_error(const char *message) {
+    std::cerr << message << std::endl;
+    MPI_Abort(MPI_COMM_WORLD, 1);
+}
+
+// Offset of the line after the one holding offset.
+size_t next_line(const board_file& f, size_t offset) {
+    const char *end = (const char *)memchr(f.data + offset, '\n', f.size - offset);
+    return end ? end - f.data + 1 : f.size;
+}
+
+// End of the line starting at offset, without the line break.
+size_t line_end(const board_file& f, size_t offset) {
+    size_t end = next_line(f, offset);
+    while (end > offset && (f.data[end - 1] == '\n' || f.data[end - 1] == '\r')) {
+        --end;
+    }
+    return end;
+}
+
+bool is_row(const board_file& f, size_t offset) {
+    return f.format != PLAINTEXT_BOARD || f.data[offset] != '!';
+}
+
+// Start of the first line at or after offset.
+size_t line_start(const board_file& f, size_t offset) {
+    return offset == 0 || f.data[offset - 1] == '\n' ? offset : next_line(f, offset);
+}
+
+// Offset of the row-th row after offset.
+size_t find_row(const board_file& f, size_t offset, long long row) {
+    for (offset = line_start(f, offset); offset < f.size; offset = next_line(f, offset)) {
+        if (is_row(f, offset) && row-- == 0) {
+            break;
+        }
+    }
+    return offset;
+}
+
+void read_rle_header(board_file& f) {
+    f.height = f.width = 0;
+    for (size_t offset = 0; offset < f.size; offset = next_line(f, offset)) {
+        if (f.data[offset] == '#') {
+            continue;
+        }
+        std::string header(f.data + offset, line_end(f, offset) - offset);
+        if (sscanf(header.c_str(), " x = %d , y = %d", &f.width, &f.height) != 2 || f.width < 0 || f.height < 0) {
+            f.height = f.width = 0;
+        }
+        f.body = next_line(f, offset);
+        break;
+    }
+}
+
+bool map_board(board_file& f, const std::string& name) {
+    f.format = board_format_of(name);
+    f.data = 0;
+    f.size = 0;
+    f.body = 0;
+    f.height = f.width = 0;
+    int fd = open(name.c_str(), O_RDONLY);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat info;
+    if (fstat(fd, &info) == 0 && info.st_size > 0) {
+        void *data = mmap(0, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            madvise(data, info.st_size, MADV_SEQUENTIAL);
+            f.data = (const char *)data;
+            f.size = info.st_size;
+        }
+    }
+    close(fd);
+    if (f.format == RLE_BOARD) {
+        read_rle_header(f);
+    }
+    return true;
+}
+
+void unmap_board(board_file& f) {
+    if (f.data) {
+        munmap((void *)f.data, f.size);
+    }
+    f.data = 0;
+}
+
+bool has_rows(const board_file& f) {
+    if (f.format == RLE_BOARD) {
+        return f.height > 0 && f.width > 0;
+    }
+    return find_row(f, 0, 0) < f.size;
+}
+
+// Splits the file into one share per rank of comm, every rank counts the rows
+// starting in its share. first_rows[s] is the first row starting in share s,
+// the last one is the height of the board. The width of a CSV board is set by
+// its first row, that of a plaintext board by its longest one.
+void index_board(board_file& f, MPI_Comm comm, std::vector<long long>& first_rows) {
+    int shares, share;
+    MPI_Comm_size(comm, &shares);
+    MPI_Comm_rank(comm, &share);
+    first_rows.assign(shares + 1, 0);
+    if (f.format == RLE_BOARD) {
+        return;
+    }
+    long long rows = 0;
+    int longest = 0;
+    size_t end = f.size * (share + 1) / shares;
+    for (size_t offset = line_start(f, f.size * share / shares); offset < end; offset = next_line(f, offset)) {
+        if (is_row(f, offset)) {
+            ++rows;
+            longest = std::max(longest, (int)(line_end(f, offset) - offset));
+        }
+    }
+    MPI_Allgather(&rows, 1, MPI_LONG_LONG, &first_rows[1], 1, MPI_LONG_LONG, comm);
+    for (int s = 0; s < shares; ++s) {
+        first_rows[s + 1] += first_rows[s];
+    }
+    f.height = first_rows[shares];
+    if (f.format == CSV_BOARD) {
+        size_t first = find_row(f, 0, 0);
+        f.width = first < f.size ? (line_end(f, first) - first + 1) / 2 : 0;
+    } else {
+        MPI_Allreduce(&longest, &f.width, 1, MPI_INT, MPI_MAX, comm);
+    }
+}
+
+// Reads the cells of the rows row_begin..row_begin+rows-1 and the columns
+// col_begin..col_begin+cols-1 of the board to the rows of table starting with
+// first. The table is clear, only live cells are set. RLE runs of the rows
+// above are skipped, lines are found through the index of index_board().
+void read_board(const board_file& f, const std::vector<long long>& first_rows, bit_table& table, int first, int row_begin, int rows, int col_begin, int cols) {
+    int col_end = col_begin + cols;
+    if (f.format == RLE_BOARD) {
+        int row = 0, col = 0;
+        long long count = 0;
+        for (size_t i = f.body; i < f.size && row < row_begin + rows; ++i) {
+            char c = f.data[i];
+            if (c >= '0' && c <= '9') {
+                count = count * 10 + c - '0';
+                continue;
+            } else if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+                continue;
+            } else if (c == '!') {
+                break;
+            }
+            long long run = count ? count : 1;
+            count = 0;
+            if (c == '$') {
+                row += run;
+                col = 0;
+            } else if (c == 'b' || c == '.') {
+                col += run;
+            } else if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')) {
+                if (row >= row_begin) {
+                    for (long long j = std::max((long long)col, (long long)col_begin); j < std::min(col + run, (long long)col_end); ++j) {
+                        set_cell(table, first + row - row_begin, j - col_begin, 1);
+                    }
+                }
+                col += run;
+            } else {
+                board_error("Incorrect RLE run");
+            }
+        }
+        return;
+    }
+    int share = std::upper_bound(first_rows.begin(), first_rows.end() - 1, (long long)row_begin) - first_rows.begin() - 1;
+    int shares = first_rows.size() - 1;
+    size_t offset = find_row(f, f.size * share / shares, row_begin - first_rows[share]);
+    for (int i = 0; i < rows; offset = next_line(f, offset)) {
+        if (!is_row(f, offset)) {
+            continue;
+        }
+        size_t end = line_end(f, offset);
+        const char *line = f.data + offset;
+        if (f.format == CSV_BOARD) {
+            if (end - offset + 1 < 2 * (size_t)f.width) {
+                board_error("Incorrect CSV field");
+            }
+            for (int j = col_begin; j < col_end; ++j) {
+                if ((line[2 * j] != '0' && line[2 * j] != '1') || (j + 1 < f.width && line[2 * j + 1] != ',')) {
+                    board_error("Incorrect CSV field");
+                }
+                if (line[2 * j] == '1') {
+                    set_cell(table, first + i, j - col_begin, 1);
+                }
+            }
+        } else {
+            for (int j = col_begin; j < col_end && offset + j < end; ++j) {
+                if (line[j] == 'O' || line[j] == '*') {
+                    set_cell(table, first + i, j - col_begin, 1);
+                } else if (line[j] != '.') {
+                    board_error("Incorrect plaintext cell");
+                }
+            }
+        }
+        ++i;
+    }
+}
+
+// Reads the whole board into the table of rank 0.
+bool load_table(bit_table& table, const std::string& name, int& height, int& width) {
+    board_file f;
+    if (!map_board(f, name)) {
+        return false;
+    }
+    std::vector<long long> first_rows;
+    index_board(f, MPI_COMM_SELF, first_rows);
+    height = f.height;
+    width = f.width;
+    resize_table(table, height, width);
+    read_board(f, first_rows, table, 0, 0, height, 0, width);
+    unmap_board(f);
+    return true;
+}
+
+// Outer-totalistic rule: a dead cell with n live neighbours is born when bit
+// n of birth is set, a live one survives when bit n of survival is set.
+// Generations rules have more than two states: a live cell that does not
+// survive goes through the states 2..states-1 before it is dead, and only a
+// dead cell is born. Larger than Life rules count the live cells of the box of
+// the given radius around a cell, the middle one too if middle is set, and
+// take ranges of counts instead of the masks.
+struct life_rule {
+    unsigned birth;
+    unsigned survival;
+    int states;
+    int radius;
+    int middle;
+    int birth_min, birth_max;
+    int survival_min, survival_max;
+};
+
+const unsigned CONWAY_BIRTH = 1 << 3; // B3/S23
+const unsigned CONWAY_SURVIVAL = 1 << 2 | 1 << 3;
+const unsigned RUNTIME_RULE = ~0u; // kernels of the rule in rule_masks
+const int MAX_RADIUS = 256;
+const int MAX_STATES = 256; // the state of a cell is a byte
+
+life_rule rule = {CONWAY_BIRTH, CONWAY_SURVIVAL, 2, 1, 0, 0, 0, 0, 0}; // set by RULE at START or by --rule
+
+// Rules the bit-parallel kernels cannot run, they go to the lattice engine.
+inline bool extended_rule(const life_rule& r) {
+    return r.states > 2 || r.radius > 1;
+}
+
+// Lookup tables of a rule with no kernels of its own: born[n] and survives[n]
+// are all ones when n neighbours give birth or survival.
+struct rule_table {
+    uint64_t born[9];
+    uint64_t survives[9];
+};
+
+rule_table rule_masks;
+
+// Lookup tables of the lattice engine, indexed by the live cells of the box
+// of a cell with the cell itself.
+std::vector<char> born_at;
+std::vector<char> survives_at;
+
+// Counts of one letter of a rule, as S23.
+bool parse_counts(const std::string& part, char letter, unsigned& counts) {
+    if (part.empty() || toupper(part[0]) != letter) {
+        return false;
+    }
+    counts = 0;
+    for (size_t i = 1; i < part.size(); ++i) {
+        if (part[i] < '0' || part[i] > '8') {
+            return false;
+        }
+        counts |= 1 << (part[i] - '0');
+    }
+    return true;
+}
+
+// Parses a rule written as B3/S23, as B2/S/C3 for Generations or as
+// R5,C0,M1,S34..58,B34..45,NM for Larger than Life. Rules that give birth at
+// a count of 0 are refused: they bring the empty tiles and the empty nodes of
+// HashLife to life.
+bool parse_rule(const std::string& text, life_rule& r) {
+    life_rule parsed = {0, 0, 2, 1, 0, 0, 0, 0, 0};
+    int length = 0;
+    char neighbourhood = 0;
+    if (sscanf(text.c_str(), "R%d,C%d,M%d,S%d..%d,B%d..%d,N%c%n", &parsed.radius, &parsed.states, &parsed.middle,
+               &parsed.survival_min, &parsed.survival_max, &parsed.birth_min, &parsed.birth_max, &neighbourhood, &length) == 8
+        && length == (int)text.size()) {
+        int box = (2 * parsed.radius + 1) * (2 * parsed.radius + 1);
+        if (neighbourhood != 'M' || parsed.radius < 1 || parsed.radius > MAX_RADIUS || parsed.states < 0 || parsed.states >= MAX_STATES
+            || parsed.middle < 0 || parsed.middle > 1 || parsed.birth_min < 1 || parsed.birth_min > parsed.birth_max || parsed.birth_max > box
+            || parsed.survival_min < 0 || parsed.survival_min > parsed.survival_max || parsed.survival_max > box) {
+            return false;
+        }
+        parsed.states = std::max(parsed.states, 2);
+        if (parsed.radius == 1) { // a Life-like rule, or Generations
+            for (int n = 0; n <= 8; ++n) {
+                parsed.birth |= (n >= parsed.birth_min && n <= parsed.birth_max) << n;
+                parsed.survival |= (n + parsed.middle >= parsed.survival_min && n + parsed.middle <= parsed.survival_max) << n;
+            }
+            parsed.middle = parsed.birth_min = parsed.birth_max = parsed.survival_min = parsed.survival_max = 0;
+        }
+    } else {
+        std::vector<std::string> parts(1);
+        for (size_t i = 0; i < text.size(); ++i) {
+            if (text[i] == '/') {
+                parts.push_back("");
+            } else {
+                parts.back() += text[i];
+            }
+        }
+        if (parts.size() < 2 || parts.size() > 3 || !parse_counts(parts[0], 'B', parsed.birth) || !parse_counts(parts[1], 'S', parsed.survival)) {
+            return false;
+        }
+        if (parts.size() == 3 && (sscanf(parts[2].c_str(), "C%d%n", &parsed.states, &length) != 1 || length != (int)parts[2].size()
+                                  || parsed.states < 2 || parsed.states >= MAX_STATES)) {
+            return false;
+        }
+        if (parsed.birth & 1) {
+            return false;
+        }
+    }
+    r = parsed;
+    return true;
+}
+
+std::string rule_name(const life_rule& r) {
+    char text[64];
+    if (r.radius > 1) {
+        snprintf(text, sizeof(text), "R%d,C%d,M%d,S%d..%d,B%d..%d,NM", r.radius, r.states > 2 ? r.states : 0, r.middle,
+                 r.survival_min, r.survival_max, r.birth_min, r.birth_max);
+        return text;
+    }
+    std::string name = "B";
+    for (int n = 0; n <= 8; ++n) {
+        if (r.birth >> n & 1) {
+            name += '0' + n;
+        }
+    }
+    name += "/S";
+    for (int n = 0; n <= 8; ++n) {
+        if (r.survival >> n & 1) {
+            name += '0' + n;
+        }
+    }
+    if (r.states > 2) {
+        snprintf(text, sizeof(text), "/C%d", r.states);
+        name += text;
+    }
+    return name;
+}
+
+// The states of the dying cells of a Generations rule, a byte per cell, none
+// for the other rules.
+void init_ages(bit_table& table) {
+    table.age.clear();
+    if (rule.states > 2) {
+        table.age.resize((size_t)table.height * table.width);
+        fill_rows(table.age.data(), (const uint8_t *)0, table.height, table.width);
+    }
+}
+
+// Next state of 64 cells of the middle row b. The arguments are the row above,
+// the middle row and the row below, each with its west- and east-shifted copy,
+// so bit n of every argument is one of the eight neighbours of cell n.
+// The neighbours are summed bit-parallel with full adders: the row sums are
+// two-bit numbers, then their ones and twos columns are added once more.
+// Conway's rule stops there, at "2 or 3 neighbours". Other rules take the whole
+// count and look it up in the rule with count_in().
+// word_t is uint64_t or a vector of them, so the same adder network serves
+// the scalar and the SIMD kernels. Vectors are passed by reference, passing
+// them by value would depend on the vector calling convention of the target.
+template <class word_t>
+inline __attribute__((always_inline))
+void select_word(word_t& result, const word_t& s, const word_t& set, const word_t& clear) {
+    result = (s & set) | (~s & clear);
+}
+
+// Cells whose count of neighbours, ones + 2 twos + 4 fours + 8 eights, has its
+// bit set in counts: a tree of selects on the bits of the count, with the nine
+// answers as leaves. The counts of a rule with kernels of its own are template
+// arguments and the tree folds down to the few selects the rule needs, the
+// leaves of RUNTIME_RULE come from a table of rule_masks.
+template <unsigned counts, class word_t>
+inline __attribute__((always_inline))
+void count_in(word_t& result, const uint64_t *table, const word_t& ones, const word_t& twos, const word_t& fours, const word_t& eights) {
+    word_t leaf[9] = {}; // all written below, the compiler does not see it through the vector types
+    for (int n = 0; n <= 8; ++n) {
+        leaf[n] = counts == RUNTIME_RULE ? word_t() | table[n] : (counts >> n & 1 ? ~word_t() : word_t());
+    }
+    word_t pairs[4], low, high, below_eight;
+    for (int n = 0; n < 4; ++n) {
+        select_word(pairs[n], ones, leaf[2 * n + 1], leaf[2 * n]);
+    }
+    select_word(low, twos, pairs[1], pairs[0]);
+    select_word(high, twos, pairs[3], pairs[2]);
+    select_word(below_eight, fours, high, low);
+    select_word(result, eights, leaf[8], below_eight); // 8 is the only count with eights
+}
+
+template <unsigned birth, unsigned survival, class word_t>
+inline __attribute__((always_inline))
+void life_word(word_t& next,
+               const word_t& wa, const word_t& a, const word_t& ea,
+               const word_t& wb, const word_t& b, const word_t& eb,
+               const word_t& wc, const word_t& c, const word_t& ec) {
+    word_t a0 = wa ^ a ^ ea;
+    word_t a1 = (wa & a) | (ea & (wa ^ a));
+    word_t c0 = wc ^ c ^ ec;
+    word_t c1 = (wc & c) | (ec & (wc ^ c));
+    word_t b0 = wb ^ eb;
+    word_t b1 = wb & eb;
+    word_t ones = a0 ^ b0 ^ c0;
+    word_t carry = (a0 & b0) | (c0 & (a0 ^ b0));
+    word_t x = a1 ^ b1;
+    word_t y = c1 ^ carry;
+    if (birth == CONWAY_BIRTH && survival == CONWAY_SURVIVAL) {
+        word_t twos = (x ^ y) & ~((a1 & b1) | (c1 & carry)); // exactly one of the four twos is set
+        next = twos & (ones | b); // 3 neighbours, or 2 neighbours and alive
+        return;
+    }
+    word_t twos = x ^ y;
+    word_t pair_a = a1 & b1;
+    word_t pair_c = c1 & carry;
+    word_t fours = pair_a ^ pair_c ^ (x & y);
+    word_t eights = pair_a & pair_c;
+    word_t born, survives;
+    count_in<birth>(born, rule_masks.born, ones, twos, fours, eights);
+    count_in<survival>(survives, rule_masks.survives, ones, twos, fours, eights);
+    select_word(next, b, survives, born);
+}
+
+// The words at both ends of a row, which the row kernels leave to the caller.
+typedef void (*life_word_kernel)(uint64_t& next,
+                                 const uint64_t& wa, const uint64_t& a, const uint64_t& ea,
+                                 const uint64_t& wb, const uint64_t& b, const uint64_t& eb,
+                                 const uint64_t& wc, const uint64_t& c, const uint64_t& ec);
+
+template <unsigned birth, unsigned survival>
+void life_word_scalar(uint64_t& next,
+                      const uint64_t& wa, const uint64_t& a, const uint64_t& ea,
+                      const uint64_t& wb, const uint64_t& b, const uint64_t& eb,
+                      const uint64_t& wc, const uint64_t& c, const uint64_t& ec) {
+    life_word<birth, survival>(next, wa, a, ea, wb, b, eb, wc, c, ec);
+}
+
+// Shifted copies of word k of a row: bit n of west_word is the west neighbour
+// of cell n, bit n of east_word is its east neighbour. west_bit and east_bit are
+// the cells beyond the row ends, last_bit is the bit of the last cell in its word.
+inline uint64_t west_word(const uint64_t *row, int k, uint64_t west_bit) {
+    return (row[k] << 1) | (k ? row[k - 1] >> 63 : west_bit);
+}
+
+inline uint64_t east_word(const uint64_t *row, int k, int row_words, uint64_t east_bit, int last_bit) {
+    return (row[k] >> 1) | (k + 1 < row_words ? row[k + 1] << 63 : east_bit << last_bit);
+}
+
+// Row kernels compute the words begin..end-1 of the next row, which must have
+// both neighbour words inside the row. The first and last words of a row wrap
+// around the torus and are left to the caller. They return the cells that
+// changed, or-ed over the words.
+typedef uint64_t (*life_row_kernel)(const uint64_t *a, const uint64_t *b, const uint64_t *c, uint64_t *next, int begin, int end);
+
+template <unsigned birth, unsigned survival>
+uint64_t life_row_scalar(const uint64_t *a, const uint64_t *b, const uint64_t *c, uint64_t *next, int begin, int end) {
+    uint64_t changes = 0;
+    for (int k = begin; k < end; ++k) {
+        life_word<birth, survival>(next[k], (a[k] << 1) | (a[k - 1] >> 63), a[k], (a[k] >> 1) | (a[k + 1] << 63),
+                                            (b[k] << 1) | (b[k - 1] >> 63), b[k], (b[k] >> 1) | (b[k + 1] << 63),
+                                            (c[k] << 1) | (c[k - 1] >> 63), c[k], (c[k] >> 1) | (c[k + 1] << 63));
+        changes |= next[k] ^ b[k];
+    }
+    return changes;
+}
+
+#if defined(__x86_64__) || defined(__i386__)
+
+typedef uint64_t vec128 __attribute__((vector_size(16)));
+typedef uint64_t vec256 __attribute__((vector_size(32)));
+typedef uint64_t vec512 __attribute__((vector_size(64)));
+
+// Loads three overlapping vectors at k - 1, k and k + 1, so lane n of the
+// shifted vectors gets the carry bit from the word next to it in memory.
+template <class vec_t, unsigned birth, unsigned survival>
+inline __attribute__((always_inline))
+uint64_t life_row_vector(const uint64_t *a, const uint64_t *b, const uint64_t *c, uint64_t *next, int begin, int end) {
+    const int lanes = sizeof(vec_t) / sizeof(uint64_t);
+    vec_t changes = vec_t();
+    int k = begin;
+    for (; k + lanes <= end; k += lanes) {
+        vec_t a0, a1, a2, b0, b1, b2, c0, c1, c2;
+        memcpy(&a0, a + k - 1, sizeof(vec_t));
+        memcpy(&a1, a + k, sizeof(vec_t));
+        memcpy(&a2, a + k + 1, sizeof(vec_t));
+        memcpy(&b0, b + k - 1, sizeof(vec_t));
+        memcpy(&b1, b + k, sizeof(vec_t));
+        memcpy(&b2, b + k + 1, sizeof(vec_t));
+        memcpy(&c0, c + k - 1, sizeof(vec_t));
+        memcpy(&c1, c + k, sizeof(vec_t));
+        memcpy(&c2, c + k + 1, sizeof(vec_t));
+        vec_t result;
+        life_word<birth, survival>(result, (a1 << 1) | (a0 >> 63), a1, (a1 >> 1) | (a2 << 63),
+                                           (b1 << 1) | (b0 >> 63), b1, (b1 >> 1) | (b2 << 63),
+                                           (c1 << 1) | (c0 >> 63), c1, (c1 >> 1) | (c2 << 63));
+        memcpy(next + k, &result, sizeof(vec_t));
+        changes |= result ^ b1;
+    }
+    uint64_t total = life_row_scalar<birth, survival>(a, b, c, next, k, end);
+    for (int lane = 0; lane < lanes; ++lane) {
+        total |= changes[lane];
+    }
+    return total;
+}
+
+template <unsigned birth, unsigned survival>
+__attribute__((target("sse2")))
+uint64_t life_row_sse2(const uint64_t *a, const uint64_t *b, const uint64_t *c, uint64_t *next, int begin, int end) {
+    return life_row_vector<vec128, birth, survival>(a, b, c, next, begin, end);
+}
+
+template <unsigned birth, unsigned survival>
+__attribute__((target("avx2")))
+uint64_t life_row_avx2(const uint64_t *a, const uint64_t *b, const uint64_t *c, uint64_t *next, int begin, int end) {
+    return life_row_vector<vec256, birth, survival>(a, b, c, next, begin, end);
+}
+
+template <unsigned birth, unsigned survival>
+__attribute__((target("avx512f")))
+uint64_t life_row_avx512(const uint64_t *a, const uint64_t *b, const uint64_t *c, uint64_t *next, int begin, int end) {
+    return life_row_vector<vec512, birth, survival>(a, b, c, next, begin, end);
+}
+
+#define RULE_KERNELS(birth, survival) {birth, survival, life_word_scalar<birth, survival>, \
+    {life_row_scalar<birth, survival>, life_row_sse2<birth, survival>, life_row_avx2<birth, survival>, life_row_avx512<birth, survival>}}
+#else
+#define RULE_KERNELS(birth, survival) {birth, survival, life_word_scalar<birth, survival>, \
+    {life_row_scalar<birth, survival>, life_row_scalar<birth, survival>, life_row_scalar<birth, survival>, life_row_scalar<birth, survival>}}
+#endif
+
+enum life_isa {SCALAR_ISA, SSE2_ISA, AVX2_ISA, AVX512_ISA};
+
+// Kernels of a rule for every instruction set.
+struct rule_kernels {
+    unsigned birth;
+    unsigned survival;
+    life_word_kernel word;
+    life_row_kernel rows[4];
+};
+
+// Rules with kernels of their own, the lookup table ones last for the rest.
+const rule_kernels RULE_KERNEL_TABLE[] = {
+    RULE_KERNELS(CONWAY_BIRTH, CONWAY_SURVIVAL),
+    RULE_KERNELS(1 << 3 | 1 << 6, CONWAY_SURVIVAL), // HighLife, B36/S23
+    RULE_KERNELS(1 << 3 | 1 << 6 | 1 << 7 | 1 << 8, 1 << 3 | 1 << 4 | 1 << 6 | 1 << 7 | 1 << 8), // Day & Night, B3678/S34678
+    RULE_KERNELS(1 << 2, 0), // Seeds, B2/S
+    RULE_KERNELS(RUNTIME_RULE, RUNTIME_RULE)};
+
+const int RULE_KERNEL_COUNT = sizeof(RULE_KERNEL_TABLE) / sizeof(RULE_KERNEL_TABLE[0]);
+
+int life_isa = SCALAR_ISA;
+life_row_kernel life_row = life_row_scalar<CONWAY_BIRTH, CONWAY_SURVIVAL>;
+life_word_kernel life_edge = life_word_scalar<CONWAY_BIRTH, CONWAY_SURVIVAL>;
+
+// Makes r the rule of the game: its own kernels if it has them, otherwise the
+// lookup table ones. Returns whether it has its own.
+bool select_rule(const life_rule& r) {
+    rule = r;
+    int i = 0;
+    while (i + 1 < RULE_KERNEL_COUNT && (RULE_KERNEL_TABLE[i].birth != r.birth || RULE_KERNEL_TABLE[i].survival != r.survival)) {
+        ++i;
+    }
+    for (int n = 0; n <= 8; ++n) {
+        rule_masks.born[n] = r.birth >> n & 1 ? ~(uint64_t)0 : 0;
+        rule_masks.survives[n] = r.survival >> n & 1 ? ~(uint64_t)0 : 0;
+    }
+    life_row = RULE_KERNEL_TABLE[i].rows[life_isa];
+    life_edge = RULE_KERNEL_TABLE[i].word;
+    int box = (2 * r.radius + 1) * (2 * r.radius + 1);
+    born_at.assign(box + 1, 0);
+    survives_at.assign(box + 1, 0);
+    for (int count = 0; count <= box; ++count) {
+        if (r.radius > 1) {
+            int own = r.middle ? count : count - 1; // a live cell is in its box
+            born_at[count] = count >= r.birth_min && count <= r.birth_max;
+            survives_at[count] = own >= r.survival_min && own <= r.survival_max;
+        } else {
+            born_at[count] = count <= 8 && (r.birth >> count & 1);
+            survives_at[count] = count >= 1 && (r.survival >> (count - 1) & 1);
+        }
+    }
+    return i + 1 < RULE_KERNEL_COUNT;
+}
+
+// Picks the widest row kernel the CPU supports, so one binary runs on every
+// node. LIFE_KERNEL=scalar|sse2|avx2|avx512 forces a kernel, the scalar one is
+// the reference the others are checked against.
+const char *select_life_row() {
+    const char *name = getenv("LIFE_KERNEL");
+    const char *chosen = "scalar";
+    life_isa = SCALAR_ISA;
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_cpu_init();
+    bool avx512 = __builtin_cpu_supports("avx512f");
+    bool avx2 = __builtin_cpu_supports("avx2");
+    bool sse2 = __builtin_cpu_supports("sse2");
+    if (name) {
+        avx512 = avx512 && strcmp(name, "avx512") == 0;
+        avx2 = avx2 && strcmp(name, "avx2") == 0;
+        sse2 = sse2 && strcmp(name, "sse2") == 0;
+    }
+    if (avx512) {
+        life_isa = AVX512_ISA;
+        chosen = "avx512";
+    } else if (avx2) {
+        life_isa = AVX2_ISA;
+        chosen = "avx2";
+    } else if (sse2) {
+        life_isa = SSE2_ISA;
+        chosen = "sse2";
+    }
+#endif
+    select_rule(rule);
+    return chosen;
+}
+
+// Ghost rows kept on each side of a block, set by --halo. They are exchanged
+// once every halo_depth generations, in between the valid part of the ghost
+// rows shrinks by one row per generation.
+int halo_depth = 1;
+
+// Cartesian grid of the ranks, each of them owns one block of the
+// board. The grid is periodic in both directions, as the board is a torus.
+struct grid {
+    MPI_Comm comm;
+    int rank;
+    int dims[2]; // dims[0] blocks from top to bottom, dims[1] from left to right
+    int coords[2];
+    int up, down, left, right;
+    int up_left, up_right, down_left, down_right;
+    MPI_Datatype column; // the same word of every owned row
+    int height, width; // of the whole board
+    int row_begin, word_begin; // first row and word of the block
+};
+
+// Splits the workers into a dims[0] x dims[1] grid of blocks, the longer side
+// of the board gets more blocks. Columns are split on word boundaries, a board
+// too small for the grid falls back to slabs of rows. So do deep halos, the
+// ghost columns of a block are a single cell wide, and the rules of the
+// lattice engine, whose rows wrap around within the block.
+void calc_dims(int workers, int height, int width, int halo, int *dims) {
+    dims[0] = dims[1] = 0;
+    MPI_Dims_create(workers, 2, dims);
+    if (width > height) {
+        std::swap(dims[0], dims[1]);
+    }
+    if (halo > 1 || extended_rule(rule) || dims[0] > height || dims[1] > calc_row_words(width)) {
+        dims[0] = workers;
+        dims[1] = 1;
+    }
+}
+
+// Splits count items into parts pieces, the first count % parts of them are
+// one item longer.
+void calc_part(int count, int parts, int part, int& begin, int& length) {
+    begin = count / parts * part + std::min(part, count % parts);
+    length = count / parts + (part < count % parts ? 1 : 0);
+}
+
+// Rows and words of the board owned by the worker with the given rank in the
+// grid. Ranks are laid out row by row, as MPI_Cart_create does.
+void calc_block(int height, int width, const int *dims, int rank, int& row_begin, int& rows, int& word_begin, int& words) {
+    calc_part(height, dims[0], rank / dims[1], row_begin, rows);
+    calc_part(calc_row_words(width), dims[1], rank % dims[1], word_begin, words);
+}
+
+int neighbour_rank(const grid& g, int di, int dj) {
+    int coords[2] = {g.coords[0] + di, g.coords[1] + dj}; // periodic, so MPI wraps them
+    int rank;
+    MPI_Cart_rank(g.comm, coords, &rank);
+    return rank;
+}
+
+void create_grid(grid& g, MPI_Comm comm, const int *dims, int rows, int row_words) {
+    int periods[2] = {1, 1};
+    g.dims[0] = dims[0];
+    g.dims[1] = dims[1];
+    MPI_Cart_create(comm, 2, g.dims, periods, 0, &g.comm);
+    MPI_Comm_rank(g.comm, &g.rank);
+    MPI_Cart_coords(g.comm, g.rank, 2, g.coords);
+    MPI_Cart_shift(g.comm, 0, 1, &g.up, &g.down);
+    MPI_Cart_shift(g.comm, 1, 1, &g.left, &g.right);
+    g.up_left = neighbour_rank(g, -1, -1);
+    g.up_right = neighbour_rank(g, -1, 1);
+    g.down_left = neighbour_rank(g, 1, -1);
+    g.down_right = neighbour_rank(g, 1, 1);
+    MPI_Type_vector(rows, 1, row_words, MPI_UINT64_T, &g.column);
+    MPI_Type_commit(&g.column);
+}
+
+// A board of fewer rows than slabs leaves the slabs after the first height
+// ones without rows. They take no part in the exchange of the ghost cells,
+// the ghost rows of the first and the last slab with rows pass over them.
+void skip_empty_slabs(grid& g, int height) {
+    if (g.dims[0] <= height) {
+        return;
+    }
+    if (g.coords[0] >= height) {
+        g.up = g.down = MPI_PROC_NULL;
+    } else {
+        int coords[2] = {g.coords[0] == 0 ? height - 1 : g.coords[0] - 1, 0};
+        MPI_Cart_rank(g.comm, coords, &g.up);
+        coords[0] = g.coords[0] == height - 1 ? 0 : g.coords[0] + 1;
+        MPI_Cart_rank(g.comm, coords, &g.down);
+    }
+    g.up_left = g.up_right = g.up; // the slabs span the whole width
+    g.down_left = g.down_right = g.down;
+}
+
+// Cells beyond the ends of the rows begin..end-1 of a block that spans the
+// whole width: the other end of the same row.
+void wrap_columns(bit_table& table, int begin, int end) {
+    for (int i = begin; i < end; ++i) {
+        table.west[i] = table_row(table, i)[table.row_words - 1];
+        table.east[i] = table_row(table, i)[0];
+    }
+}
+
+// Counters of one rank, reduced to rank 0 by STATS. Times are in
+// seconds since the start.
+struct perf_counters {
+    double compute; // in the kernels
+    double border_wait; // blocked on the ghost cells
+    double idle; // waiting and polling for commands
+    double run; // in whole generations
+    double bytes; // of ghost cells sent
+    double generations;
+    double cells; // updated
+};
+
+perf_counters perf;
+
+// Per-generation timeline of every rank, written at QUIT to the file set by
+// --trace in the Chrome trace format.
+struct trace_event {
+    const char *name;
+    double start;
+    double length;
+    int generation;
+};
+
+std::string trace_file;
+std::vector<trace_event> trace;
+double trace_origin; // MPI_Wtime() of every rank at about the same moment
+
+void add_trace(const char *name, double start, double end, int generation) {
+    if (!trace_file.empty()) {
+        trace_event event = {name, start - trace_origin, end - start, generation};
+        trace.push_back(event);
     }
 }
 
-void set_csv_table(std::vector<char>& table, const char *csv_file, int& height, int& width) {
-    std::ifstream in(csv_file);
+// Edge of the tiles a block is cut into to skip the parts of the board that
+// did not change: 32 rows of 8 words, 16384 cells.
+const int ACTIVE_TILE_ROWS = 32;
+const int ACTIVE_TILE_WORDS = 8;
+
+// Tiles of the owned rows that changed in the last generation. A tile none of
+// whose eight neighbours changed is not recomputed, the other parity buffer
+// already holds its state. Ghost cells next to the owned rows are compared with
+// the last ones seen to find the border tiles that have to be recomputed.
+// A neighbour whose border rows did not change since the last exchange sends
+// an empty message, then the copy received last time is used.
+struct activity {
+    bool enabled;
+    bool primed; // the ghost cells were seen once
+    int rows, cols;
+    std::vector<char> changed;
+    std::vector<char> next_changed;
+    std::vector<char> active;
+    std::vector<uint64_t> top, bottom, west, east;
+    std::vector<uint64_t> sent_up, sent_down, sent_left, sent_right;
+    std::vector<uint64_t> received_up, received_down, received_left, received_right;
+};
+
+bool skip_tiles = true; // cleared by --no-skip
+
+void init_activity(activity& act, const bit_table& table) {
+    act.enabled = skip_tiles && !extended_rule(rule); // the lattice engine computes whole rows
+    act.primed = false;
+    act.rows = (table.height - 2 * table.halo + ACTIVE_TILE_ROWS - 1) / ACTIVE_TILE_ROWS;
+    act.cols = (table.row_words + ACTIVE_TILE_WORDS - 1) / ACTIVE_TILE_WORDS;
+    act.changed.assign(act.rows * act.cols, 1);
+    act.next_changed.assign(act.rows * act.cols, 0);
+    act.active.assign(act.rows * act.cols, 1);
+    act.sent_up.clear();
+    act.sent_down.clear();
+    act.sent_left.clear();
+    act.sent_right.clear();
+}
+
+// Number of words of a border to send: none if they did not change since they
+// were sent last time.
+int border_count(activity& act, std::vector<uint64_t>& sent, const uint64_t *words, int count) {
+    if (!act.enabled) {
+        return count;
+    }
+    if (sent.size() == (size_t)count && std::equal(words, words + count, sent.begin())) {
+        return 0;
+    }
+    sent.assign(words, words + count);
+    return count;
+}
+
+int column_count(activity& act, std::vector<uint64_t>& sent, const bit_table& table, int k) {
+    if (!act.enabled) {
+        return 1;
+    }
+    std::vector<uint64_t> column(table.height - 2 * table.halo);
+    for (size_t i = 0; i < column.size(); ++i) {
+        column[i] = table_row(table, table.halo + i)[k];
+    }
+    return border_count(act, sent, &column[0], column.size()) ? 1 : 0;
+}
+
+// Puts back the border received last time if the neighbour sent an empty
+// message, remembers it otherwise.
+void restore_border(const MPI_Status& status, std::vector<uint64_t>& received, uint64_t *words, int count) {
+    int received_count;
+    MPI_Get_count(&status, MPI_UINT64_T, &received_count);
+    if (received_count == 0) {
+        std::copy(received.begin(), received.end(), words);
+    } else {
+        received.assign(words, words + count);
+    }
+}
+
+const int BORDER_REQUESTS = 16;
+
+// Requests of one exchange of ghost cells.
+struct exchange {
+    MPI_Request requests[BORDER_REQUESTS];
+    MPI_Status statuses[BORDER_REQUESTS];
+    int done;
+};
+
+// The exchange of the ghost cells of one table, set up once with persistent
+// requests: the buffers, counts and neighbours stay the same from one
+// generation to the next, only the two tables take turns. A border that did
+// not change goes as an empty message, which has requests of its own.
+struct border_plan {
+    const uint64_t *words; // of the table the requests point into
+    const uint8_t *age;
+    int height;
+    MPI_Request full[BORDER_REQUESTS];
+    MPI_Request empty[BORDER_REQUESTS];
+};
+
+std::vector<border_plan> border_plans; // of the two tables of the game
+
+void free_border_plans() {
+    for (size_t p = 0; p < border_plans.size(); ++p) {
+        for (int i = 0; i < BORDER_REQUESTS; ++i) {
+            if (border_plans[p].full[i] != MPI_REQUEST_NULL) {
+                MPI_Request_free(&border_plans[p].full[i]);
+            }
+            if (border_plans[p].empty[i] != MPI_REQUEST_NULL) {
+                MPI_Request_free(&border_plans[p].empty[i]);
+            }
+        }
+    }
+    border_plans.clear();
+}
+
+// Sets up the requests of the exchange described at send_borders().
+void init_border_plan(border_plan& plan, bit_table& table, const grid& g) {
+    int height = table.height;
+    int row_words = table.row_words;
+    int halo = table.halo;
+    plan.words = &table.words[0];
+    plan.age = table.age.empty() ? 0 : &table.age[0];
+    plan.height = height;
+    MPI_Request *full = plan.full;
+    MPI_Request *empty = plan.empty;
+    for (int i = 0; i < BORDER_REQUESTS; ++i) {
+        full[i] = empty[i] = MPI_REQUEST_NULL;
+    }
+    if (g.dims[0] > 1) {
+        int count = halo * row_words;
+        MPI_Recv_init(table_row(table, height - halo), count, MPI_UINT64_T, g.down, UP, g.comm, &full[0]);
+        MPI_Recv_init(table_row(table, 0), count, MPI_UINT64_T, g.up, DOWN, g.comm, &full[1]);
+        MPI_Send_init(table_row(table, halo), count, MPI_UINT64_T, g.up, UP, g.comm, &full[2]);
+        MPI_Send_init(table_row(table, height - 2 * halo), count, MPI_UINT64_T, g.down, DOWN, g.comm, &full[3]);
+        MPI_Send_init(table_row(table, halo), 0, MPI_UINT64_T, g.up, UP, g.comm, &empty[2]);
+        MPI_Send_init(table_row(table, height - 2 * halo), 0, MPI_UINT64_T, g.down, DOWN, g.comm, &empty[3]);
+        if (!table.age.empty()) { // the dying cells of a Generations rule, its blocks span the whole width
+            uint8_t *age = &table.age[0];
+            count = halo * table.width;
+            MPI_Recv_init(age + (size_t)(height - halo) * table.width, count, MPI_UINT8_T, g.down, AGE_UP, g.comm, &full[4]);
+            MPI_Recv_init(age, count, MPI_UINT8_T, g.up, AGE_DOWN, g.comm, &full[5]);
+            MPI_Send_init(age + (size_t)halo * table.width, count, MPI_UINT8_T, g.up, AGE_UP, g.comm, &full[6]);
+            MPI_Send_init(age + (size_t)(height - 2 * halo) * table.width, count, MPI_UINT8_T, g.down, AGE_DOWN, g.comm, &full[7]);
+        }
+    }
+    if (g.dims[1] > 1) {
+        uint64_t *first = table_row(table, 1);
+        uint64_t *last = table_row(table, height - 2);
+        MPI_Recv_init(&table.east[1], height - 2, MPI_UINT64_T, g.right, LEFT, g.comm, &full[4]);
+        MPI_Recv_init(&table.west[1], height - 2, MPI_UINT64_T, g.left, RIGHT, g.comm, &full[5]);
+        MPI_Send_init(&first[0], 1, g.column, g.left, LEFT, g.comm, &full[6]);
+        MPI_Send_init(&first[row_words - 1], 1, g.column, g.right, RIGHT, g.comm, &full[7]);
+        MPI_Send_init(&first[0], 0, g.column, g.left, LEFT, g.comm, &empty[6]);
+        MPI_Send_init(&first[row_words - 1], 0, g.column, g.right, RIGHT, g.comm, &empty[7]);
+        MPI_Recv_init(&table.east[height - 1], 1, MPI_UINT64_T, g.down_right, UP_LEFT, g.comm, &full[8]);
+        MPI_Recv_init(&table.west[height - 1], 1, MPI_UINT64_T, g.down_left, UP_RIGHT, g.comm, &full[9]);
+        MPI_Recv_init(&table.east[0], 1, MPI_UINT64_T, g.up_right, DOWN_LEFT, g.comm, &full[10]);
+        MPI_Recv_init(&table.west[0], 1, MPI_UINT64_T, g.up_left, DOWN_RIGHT, g.comm, &full[11]);
+        MPI_Send_init(&first[0], 1, MPI_UINT64_T, g.up_left, UP_LEFT, g.comm, &full[12]);
+        MPI_Send_init(&first[row_words - 1], 1, MPI_UINT64_T, g.up_right, UP_RIGHT, g.comm, &full[13]);
+        MPI_Send_init(&last[0], 1, MPI_UINT64_T, g.down_left, DOWN_LEFT, g.comm, &full[14]);
+        MPI_Send_init(&last[row_words - 1], 1, MPI_UINT64_T, g.down_right, DOWN_RIGHT, g.comm, &full[15]);
+    }
+}
+
+// The plan of the table, set up the first time the table is exchanged.
+// Tables that move or change their size need free_border_plans() first.
+border_plan& find_border_plan(bit_table& table, const grid& g) {
+    const uint8_t *age = table.age.empty() ? 0 : &table.age[0];
+    for (size_t p = 0; p < border_plans.size(); ++p) {
+        if (border_plans[p].words == &table.words[0] && border_plans[p].age == age && border_plans[p].height == table.height) {
+            return border_plans[p];
+        }
+    }
+    if (border_plans.size() == 2) { // a table that went away
+        free_border_plans();
+    }
+    border_plans.push_back(border_plan());
+    init_border_plan(border_plans.back(), table, g);
+    return border_plans.back();
+}
+
+// Starts the exchange of the ghost cells and returns at once: the ghost rows
+// from the blocks above and below, the cells west and east of the owned rows
+// from the blocks to the left and right, and the four corner cells from the
+// diagonal blocks. The ghost cells may be read only after wait_borders(), the
+// owned rows are just read by the sends and can be computed meanwhile.
+// A grid dimension of one block wraps onto the block itself and is copied.
+// Blocks with deep halos span the whole width, so only their rows are sent.
+void send_borders(bit_table& table, const grid& g, exchange& ex, activity& act) {
+    int height = table.height;
+    int row_words = table.row_words;
+    int halo = table.halo;
+    border_plan& plan = find_border_plan(table, g);
+    MPI_Request *requests = ex.requests;
+    std::copy(plan.full, plan.full + BORDER_REQUESTS, requests);
+    ex.done = 0;
+    if (g.dims[0] > 1) {
+        int count = halo * row_words;
+        int up_count = border_count(act, act.sent_up, table_row(table, halo), count);
+        int down_count = border_count(act, act.sent_down, table_row(table, height - 2 * halo), count);
+        requests[2] = up_count ? plan.full[2] : plan.empty[2];
+        requests[3] = down_count ? plan.full[3] : plan.empty[3];
+        perf.bytes += (up_count + down_count) * sizeof(uint64_t);
+    } else {
+        std::copy(table_row(table, halo), table_row(table, 2 * halo), table_row(table, height - halo));
+        std::copy(table_row(table, height - 2 * halo), table_row(table, height - halo), table_row(table, 0));
+    }
+    if (!table.age.empty()) {
+        uint8_t *age = &table.age[0];
+        if (g.dims[0] > 1) {
+            perf.bytes += 2 * halo * table.width;
+        } else {
+            std::copy(age + (size_t)halo * table.width, age + (size_t)2 * halo * table.width, age + (size_t)(height - halo) * table.width);
+            std::copy(age + (size_t)(height - 2 * halo) * table.width, age + (size_t)(height - halo) * table.width, age);
+        }
+    }
+    if (g.dims[1] > 1) {
+        int left_count = column_count(act, act.sent_left, table, 0);
+        int right_count = column_count(act, act.sent_right, table, row_words - 1);
+        requests[6] = left_count ? plan.full[6] : plan.empty[6];
+        requests[7] = right_count ? plan.full[7] : plan.empty[7];
+        perf.bytes += ((left_count + right_count) * (height - 2) + 4) * sizeof(uint64_t);
+    } else {
+        wrap_columns(table, halo, height - halo);
+    }
+    MPI_Request started[BORDER_REQUESTS];
+    int count = 0;
+    for (int i = 0; i < BORDER_REQUESTS; ++i) {
+        if (requests[i] != MPI_REQUEST_NULL) {
+            started[count++] = requests[i];
+        }
+    }
+    MPI_Startall(count, started);
+}
+
+void poll_borders(exchange& ex) {
+    if (!ex.done) {
+        MPI_Testall(BORDER_REQUESTS, ex.requests, &ex.done, ex.statuses);
+    }
+}
+
+void wait_borders(bit_table& table, const grid& g, exchange& ex, activity& act) {
+    if (!ex.done) {
+        MPI_Waitall(BORDER_REQUESTS, ex.requests, ex.statuses);
+    }
+    int height = table.height;
+    int halo = table.halo;
+    if (act.enabled && g.dims[0] > 1) {
+        restore_border(ex.statuses[0], act.received_down, table_row(table, height - halo), halo * table.row_words);
+        restore_border(ex.statuses[1], act.received_up, table_row(table, 0), halo * table.row_words);
+    }
+    if (act.enabled && g.dims[1] > 1) {
+        restore_border(ex.statuses[4], act.received_right, &table.east[halo], height - 2 * halo);
+        restore_border(ex.statuses[5], act.received_left, &table.west[halo], height - 2 * halo);
+    }
+    if (g.dims[1] == 1) {
+        wrap_columns(table, 0, table.halo);
+        wrap_columns(table, table.height - table.halo, table.height);
+    }
+}
+
+// Commands are read by rank 0 and go to all the ranks over control_comm,
+// apart from the data of the board. Every rank owns a block, rank 0 too.
+MPI_Comm control_comm;
+
+// Generations between two looks of a running game for a command, set by
+// --check-every. Rank 0 broadcasts the next command, or WAIT when there is
+// none, so every rank takes a command at the same generation.
+int check_every = 16;
+
+// Lines of stdin, read by a thread of rank 0 so the game goes on while a
+// command is typed. The thread makes no MPI calls. The end of the input reads
+// as QUIT.
+struct console {
+    std::mutex lock;
+    std::condition_variable ready;
+    std::deque<std::string> lines;
+};
+
+void read_console(console *c) {
     std::string line;
-    height = 0;
-    while(std::getline(in, line)) {
-        height++;
-        if (height == 1) {
-            width = 0;
-            for (int i = 0; i < line.size(); ++i) {
-                if (i % 2 == 0) {
-                    if (line[i] == '0') {
-                        width++;
-                        table.push_back(0);
-                    } else if (line[i] == '1') {
-                        width++;
-                        table.push_back(1);
-                    } else {
-                        std::cerr << "Incorrect CSV field" << std::endl;
-                        exit(1);
+    std::string cmd;
+    while (cmd != "QUIT") {
+        if (!std::getline(std::cin, line)) {
+            line = "QUIT";
+        }
+        std::istringstream in(line);
+        if (!(in >> cmd)) {
+            continue;
+        }
+        std::lock_guard<std::mutex> guard(c->lock);
+        c->lines.push_back(line);
+        c->ready.notify_one();
+    }
+}
+
+// Next command line. A running game takes only RUN, STOP and STATUS, the
+// other commands wait for the end of the run, so there may be no line to take
+// then.
+std::string take_line(console& c, bool running) {
+    std::unique_lock<std::mutex> guard(c.lock);
+    while (!running && c.lines.empty()) {
+        c.ready.wait(guard);
+    }
+    if (c.lines.empty()) {
+        return "";
+    }
+    std::string cmd;
+    std::istringstream(c.lines.front()) >> cmd;
+    if (running && cmd != "RUN" && cmd != "STOP" && cmd != "STATUS") {
+        return "";
+    }
+    std::string line = c.lines.front();
+    c.lines.pop_front();
+    return line;
+}
+
+// Output of rank 0 gathered in large pieces, not a stream insertion and a
+// flush per cell or row.
+struct text_writer {
+    std::string buffer;
+};
+
+const size_t TEXT_BUFFER = 1 << 16;
+
+inline void write_text(text_writer& out, const char *text, size_t length) {
+    out.buffer.append(text, length);
+    if (out.buffer.size() >= TEXT_BUFFER) {
+        std::cout.write(out.buffer.data(), out.buffer.size());
+        out.buffer.clear();
+    }
+}
+
+void flush_text(text_writer& out) {
+    std::cout.write(out.buffer.data(), out.buffer.size());
+    std::cout.flush();
+    out.buffer.clear();
+}
+
+void print_table(const bit_table& table, long long iteration) {
+    std::cout << "Iteration: " << iteration << std::endl;
+    text_writer out;
+    std::string line(2 * table.width + 1, ' ');
+    line[2 * table.width] = '\n';
+    for (int i = 0; i < table.height; ++i) {
+        for(int j = 0; j < table.width; ++j) {
+            line[2 * j] = get_cell(table, i, j) ? '1' : '0';
+        }
+        write_text(out, line.data(), line.size());
+    }
+    flush_text(out);
+}
+
+// What STATUS shows: the whole board, a window of it as RLE, the density of
+// its side x side squares, or as RLE the cells changed since the last
+// STATUS DELTA.
+enum status_mode {STATUS_BOARD, STATUS_REGION, STATUS_DENSITY, STATUS_DELTA};
+
+struct status_view {
+    int mode;
+    int x; // the window, the whole board but for STATUS_REGION
+    int y;
+    int width;
+    int height;
+    int side;
+};
+
+// Arguments of STATUS: none, "x y w h" for a window, "DENSITY side" or
+// "DELTA". The window is clipped to the board.
+bool read_status_view(std::istream& in, int height, int width, status_view& view) {
+    view.mode = STATUS_BOARD;
+    view.x = view.y = 0;
+    view.width = width;
+    view.height = height;
+    view.side = 1;
+    std::string word;
+    if (!(in >> word)) {
+        return true;
+    } else if (word == "DENSITY") {
+        view.mode = STATUS_DENSITY;
+        return (in >> view.side) && view.side > 0;
+    } else if (word == "DELTA") {
+        view.mode = STATUS_DELTA;
+        return true;
+    }
+    int x, y, w, h;
+    if (word.find_first_not_of("-0123456789") != std::string::npos || !(in >> y >> w >> h) || w <= 0 || h <= 0) {
+        return false;
+    }
+    x = atoi(word.c_str());
+    view.mode = STATUS_REGION;
+    view.x = std::max(0, x);
+    view.y = std::max(0, y);
+    view.width = std::min((long long)width, (long long)x + w) - view.x;
+    view.height = std::min((long long)height, (long long)y + h) - view.y;
+    return view.width > 0 && view.height > 0;
+}
+
+// Row, first column and length of a run of live cells, or of changed cells
+// for STATUS DELTA, in board coordinates.
+struct cell_run {
+    int row;
+    int column;
+    int length;
+};
+
+inline bool operator<(const cell_run& a, const cell_run& b) {
+    return a.row < b.row || (a.row == b.row && a.column < b.column);
+}
+
+// Runs in the window of the view of rows first .. first + rows - 1 of the
+// table, which are the rows of the board from row_begin and its columns from
+// column_begin. With a previous table the runs are of the cells that differ.
+void collect_runs(const bit_table& table, const bit_table *previous, int first, int rows, int row_begin, int column_begin,
+                  const status_view& view, std::vector<cell_run>& runs) {
+    int begin = std::max(0, view.x - column_begin);
+    int end = std::min(table.width, view.x + view.width - column_begin);
+    int row_from = std::max(0, view.y - row_begin);
+    int row_to = std::min(rows, view.y + view.height - row_begin);
+    if (begin >= end) {
+        return;
+    }
+    for (int i = row_from; i < row_to; ++i) {
+        const uint64_t *cells = table_row(table, first + i);
+        const uint64_t *old = previous ? table_row(*previous, first + i) : 0;
+        for (int k = begin >> 6; k <= (end - 1) >> 6; ++k) {
+            uint64_t word = old ? cells[k] ^ old[k] : cells[k];
+            if (64 * k < begin) {
+                word &= ~0ULL << (begin - 64 * k);
+            }
+            if (end - 64 * k < 64) {
+                word &= ((uint64_t)1 << (end - 64 * k)) - 1;
+            }
+            while (word) {
+                int start = __builtin_ctzll(word);
+                uint64_t rest = ~(word >> start);
+                int length = rest ? __builtin_ctzll(rest) : 64;
+                cell_run run = {row_begin + i, column_begin + 64 * k + start, length};
+                if (!runs.empty() && runs.back().row == run.row && runs.back().column + runs.back().length == run.column) {
+                    runs.back().length += length; // goes on from the last word
+                } else {
+                    runs.push_back(run);
+                }
+                word = start + length < 64 ? word & (~0ULL << (start + length)) : 0;
+            }
+        }
+    }
+}
+
+// The runs of every rank go to rank 0, sorted and joined across the blocks.
+void gather_runs(std::vector<cell_run>& runs, int rank, int size) {
+    int count = 3 * runs.size();
+    std::vector<int> counts(size), displs(size);
+    MPI_Gather(&count, 1, MPI_INT, &counts[0], 1, MPI_INT, 0, control_comm);
+    for (int i = 1; i < size; ++i) {
+        displs[i] = displs[i - 1] + counts[i - 1];
+    }
+    std::vector<cell_run> all(rank == 0 ? (displs[size - 1] + counts[size - 1]) / 3 + 1 : 1);
+    MPI_Gatherv(runs.data(), count, MPI_INT, &all[0], &counts[0], &displs[0], MPI_INT, 0, control_comm);
+    runs.clear();
+    if (rank != 0) {
+        return;
+    }
+    all.pop_back();
+    std::sort(all.begin(), all.end());
+    for (size_t i = 0; i < all.size(); ++i) {
+        if (!runs.empty() && runs.back().row == all[i].row && runs.back().column + runs.back().length == all[i].column) {
+            runs.back().length += all[i].length;
+        } else {
+            runs.push_back(all[i]);
+        }
+    }
+}
+
+// Lines of RLE are kept within 70 characters.
+struct rle_writer {
+    text_writer out;
+    int line;
+};
+
+void write_rle_run(rle_writer& rle, int count, char tag) {
+    char run[16];
+    int length = count > 1 ? snprintf(run, sizeof(run), "%d%c", count, tag) : snprintf(run, sizeof(run), "%c", tag);
+    if (rle.line + length > 70) {
+        write_text(rle.out, "\n", 1);
+        rle.line = 0;
+    }
+    write_text(rle.out, run, length);
+    rle.line += length;
+}
+
+// The sorted runs of the window as RLE, its corner in a #R line, so the output
+// loads back as a board file.
+void print_runs(const std::vector<cell_run>& runs, const status_view& view, const std::string& comment, long long iteration) {
+    std::cout << "Iteration: " << iteration << std::endl;
+    rle_writer rle;
+    rle.line = 0;
+    char header[128];
+    int length = snprintf(header, sizeof(header), "#R %d %d\nx = %d, y = %d, rule = %s\n", view.x, view.y, view.width, view.height, rule_name(rule).c_str());
+    write_text(rle.out, "#C ", 3);
+    write_text(rle.out, comment.data(), comment.size());
+    write_text(rle.out, "\n", 1);
+    write_text(rle.out, header, length);
+    int row = view.y;
+    int column = view.x;
+    for (size_t i = 0; i < runs.size(); ++i) {
+        if (runs[i].row > row) {
+            write_rle_run(rle, runs[i].row - row, '$');
+            row = runs[i].row;
+            column = view.x;
+        }
+        if (runs[i].column > column) {
+            write_rle_run(rle, runs[i].column - column, 'b');
+        }
+        write_rle_run(rle, runs[i].length, 'o');
+        column = runs[i].column + runs[i].length;
+    }
+    write_rle_run(rle, 1, '!');
+    write_text(rle.out, "\n", 1);
+    flush_text(rle.out);
+}
+
+// Live cells of every side x side square of rows first .. first + rows - 1
+// of the table, placed as in collect_runs(). bins is the number of squares
+// in a row of the board.
+void count_density(const bit_table& table, int first, int rows, int row_begin, int column_begin, int side, int bins,
+                   std::vector<long long>& counts) {
+    for (int i = 0; i < rows; ++i) {
+        const uint64_t *cells = table_row(table, first + i);
+        long long *line = &counts[(size_t)((row_begin + i) / side) * bins];
+        for (int k = 0; k < table.row_words; ++k) {
+            for (uint64_t word = cells[k]; word; word &= word - 1) {
+                line[(column_begin + 64 * k + __builtin_ctzll(word)) / side]++;
+            }
+        }
+    }
+}
+
+// The share of live cells of every square as a digit, 0 for none, 9 for all.
+void print_density(const std::vector<long long>& counts, int height, int width, int side, long long iteration) {
+    std::cout << "Iteration: " << iteration << std::endl;
+    text_writer out;
+    int bins = (width + side - 1) / side;
+    std::string line(2 * bins + 1, ' ');
+    line[2 * bins] = '\n';
+    for (int r = 0; (long long)r * side < height; ++r) {
+        long long rows = std::min(side, height - r * side);
+        for (int c = 0; c < bins; ++c) {
+            long long area = rows * std::min(side, width - c * side);
+            line[2 * c] = '0' + (counts[(size_t)r * bins + c] * 9 + area - 1) / area;
+        }
+        write_text(out, line.data(), line.size());
+    }
+    flush_text(out);
+}
+
+// Block of a rank at the last STATUS DELTA, row_begin is -1 before the first.
+struct status_snapshot {
+    bit_table table;
+    int row_begin;
+    int generation;
+};
+
+// STATUS of a window, of the density or of the changes. Only runs or counts
+// travel to rank 0, never the whole board. A delta takes the whole board when
+// some rank has no snapshot of its block, since the rows moved with the load.
+void print_view(const bit_table& table, const grid& g, int iteration, const status_view& view, status_snapshot& snapshot, int size) {
+    int halo = table.halo;
+    int rows = table.height - 2 * halo;
+    if (view.mode == STATUS_DENSITY) {
+        int bins = (g.width + view.side - 1) / view.side;
+        std::vector<long long> counts((size_t)((g.height + view.side - 1) / view.side) * bins);
+        std::vector<long long> total(g.rank == 0 ? counts.size() : 0);
+        count_density(table, halo, rows, g.row_begin, 64 * g.word_begin, view.side, bins, counts);
+        MPI_Reduce(&counts[0], total.data(), counts.size(), MPI_LONG_LONG, MPI_SUM, 0, control_comm);
+        if (g.rank == 0) {
+            print_density(total, g.height, g.width, view.side, iteration);
+        }
+        return;
+    }
+    const bit_table *previous = 0;
+    std::string comment = "Window of generation " + std::to_string(iteration);
+    if (view.mode == STATUS_DELTA) {
+        int known = snapshot.row_begin == g.row_begin && snapshot.table.words.size() == table.words.size();
+        int all_known;
+        MPI_Allreduce(&known, &all_known, 1, MPI_INT, MPI_MIN, control_comm);
+        if (all_known) {
+            previous = &snapshot.table;
+            comment = "Changes from generation " + std::to_string(snapshot.generation) + " to " + std::to_string(iteration);
+        } else {
+            comment = "Generation " + std::to_string(iteration) + ", no earlier snapshot";
+        }
+    }
+    std::vector<cell_run> runs;
+    collect_runs(table, previous, halo, rows, g.row_begin, 64 * g.word_begin, view, runs);
+    if (view.mode == STATUS_DELTA) {
+        snapshot.table = table;
+        snapshot.row_begin = g.row_begin;
+        snapshot.generation = iteration;
+    }
+    gather_runs(runs, g.rank, size);
+    if (g.rank == 0) {
+        print_runs(runs, view, comment, iteration);
+    }
+}
+
+// STATUS of the whole board on its way to rank 0. Every rank copies its block
+// and sends the copy, the game goes on meanwhile. Rank 0 prints the board from
+// a thread of its own once all the blocks came, the thread makes no MPI calls.
+// Anything else rank 0 prints waits for finish_status().
+struct status_output {
+    std::vector<uint64_t> block; // the owned rows of the rank when STATUS came
+    bit_table board; // on rank 0
+    std::vector<MPI_Request> requests;
+    int iteration;
+    int period; // of the board, 0 if not known
+    bool pending;
+    std::thread writer;
+};
+
+void print_board(const bit_table *board, long long iteration, int period) {
+    print_table(*board, iteration);
+    if (period) {
+        std::cout << "Period: " << period << std::endl;
+    }
+}
+
+// Prints the board once the blocks came, returns whether they did.
+bool poll_status(status_output& out, int rank) {
+    if (!out.pending) {
+        return true;
+    }
+    int done;
+    MPI_Testall(out.requests.size(), &out.requests[0], &done, MPI_STATUSES_IGNORE);
+    if (!done) {
+        return false;
+    }
+    out.pending = false;
+    std::vector<uint64_t>().swap(out.block);
+    if (rank == 0) {
+        out.writer = std::thread(print_board, &out.board, (long long)out.iteration, out.period);
+    }
+    return true;
+}
+
+void finish_status(status_output& out, int rank) {
+    if (out.pending) {
+        MPI_Waitall(out.requests.size(), &out.requests[0], MPI_STATUSES_IGNORE);
+        poll_status(out, rank);
+    }
+    if (out.writer.joinable()) {
+        out.writer.join();
+    }
+}
+
+// Starts a STATUS of the whole board. The blocks move with the load, so they
+// tell where they lie.
+void start_status(status_output& out, const bit_table& table, const grid& g, int iteration, int period, int size) {
+    finish_status(out, g.rank);
+    int halo = table.halo;
+    int rows = table.height - 2 * halo;
+    int block[4] = {g.row_begin, rows, g.word_begin, table.row_words};
+    std::vector<int> layout(4 * size);
+    MPI_Gather(block, 4, MPI_INT, &layout[0], 4, MPI_INT, 0, control_comm);
+    out.requests.assign(size + 1, MPI_REQUEST_NULL);
+    if (g.rank == 0) {
+        resize_table(out.board, g.height, g.width);
+        for (int i = 0; i < size; ++i) {
+            MPI_Datatype type;
+            MPI_Type_vector(layout[4 * i + 1], layout[4 * i + 3], out.board.row_words, MPI_UINT64_T, &type);
+            MPI_Type_commit(&type);
+            MPI_Irecv(table_row(out.board, layout[4 * i]) + layout[4 * i + 2], 1, type, i, BLOCK, MPI_COMM_WORLD, &out.requests[i]);
+            MPI_Type_free(&type);
+        }
+    }
+    out.block.assign(table_row(table, halo), table_row(table, halo + rows));
+    MPI_Isend(out.block.data(), out.block.size(), MPI_UINT64_T, 0, BLOCK, MPI_COMM_WORLD, &out.requests[size]);
+    out.iteration = iteration;
+    out.period = period;
+    out.pending = true;
+}
+
+const int PERF_VALUES = 7;
+
+// The counters of a rank as reduced by STATS, the rates over the time spent
+// in generations.
+void perf_values(double *values) {
+    values[0] = perf.compute;
+    values[1] = perf.border_wait;
+    values[2] = perf.idle;
+    values[3] = perf.bytes;
+    values[4] = perf.generations;
+    values[5] = perf.run > 0 ? perf.generations / perf.run : 0;
+    values[6] = perf.run > 0 ? perf.cells / perf.run : 0;
+}
+
+// Minimum, average and maximum of the counters over the ranks, printed by
+// rank 0.
+void print_stats(int rank, int size) {
+    static const char *names[PERF_VALUES] = {"compute, s", "ghost wait, s", "idle, s", "bytes sent", "generations", "generations/s", "cell updates/s"};
+    double values[PERF_VALUES], min[PERF_VALUES], max[PERF_VALUES], sum[PERF_VALUES];
+    perf_values(values);
+    MPI_Reduce(values, min, PERF_VALUES, MPI_DOUBLE, MPI_MIN, 0, control_comm);
+    MPI_Reduce(values, max, PERF_VALUES, MPI_DOUBLE, MPI_MAX, 0, control_comm);
+    MPI_Reduce(values, sum, PERF_VALUES, MPI_DOUBLE, MPI_SUM, 0, control_comm);
+    if (rank != 0) {
+        return;
+    }
+    std::cout << "Stats of " << size << " ranks: min avg max" << std::endl;
+    for (int i = 0; i < PERF_VALUES; ++i) {
+        std::cout << names[i] << ": " << min[i] << ' ' << sum[i] / size << ' ' << max[i] << std::endl;
+    }
+    std::cout << "total cell updates/s: " << sum[PERF_VALUES - 1] << std::endl;
+}
+
+// The timelines go to rank 0, which writes the file: one thread per rank.
+void write_trace(int rank, int size) {
+    std::string events;
+    char line[256];
+    for (size_t i = 0; i < trace.size(); ++i) {
+        const trace_event& e = trace[i];
+        snprintf(line, sizeof(line), ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f", e.name, rank, e.start * 1e6, e.length * 1e6);
+        events += line;
+        if (e.generation >= 0) {
+            snprintf(line, sizeof(line), ",\"args\":{\"generation\":%d}", e.generation);
+            events += line;
+        }
+        events += "}";
+    }
+    snprintf(line, sizeof(line), ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%d,\"args\":{\"name\":\"rank %d\"}}", rank, rank);
+    events += line;
+    int length = events.size();
+    std::vector<int> lengths(size), displs(size);
+    MPI_Gather(&length, 1, MPI_INT, &lengths[0], 1, MPI_INT, 0, control_comm);
+    for (int i = 1; i < size; ++i) {
+        displs[i] = displs[i - 1] + lengths[i - 1];
+    }
+    std::vector<char> all(rank == 0 ? displs[size - 1] + lengths[size - 1] + 1 : 1);
+    MPI_Gatherv((void *)events.data(), length, MPI_CHAR, &all[0], &lengths[0], &displs[0], MPI_CHAR, 0, control_comm);
+    if (rank != 0) {
+        return;
+    }
+    std::ofstream out(trace_file.c_str());
+    out << "{\"traceEvents\":[\n{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":0,\"args\":{\"name\":\"Life\"}}";
+    out.write(&all[0], all.size() - 1);
+    out << "\n]}\n";
+    if (!out) {
+        std::cerr << "Cannot write " << trace_file << std::endl;
+    }
+}
+
+// Words of a row swept together down a block of rows: three rows of a tile
+// (12 KB) stay in L1 while the tile moves down.
+const int TILE_WORDS = 512;
+
+// Computes the words begin..end-1 of row i of next_table, returns the cells
+// that changed or-ed over the words.
+uint64_t iterate_words(const bit_table& table, bit_table& next_table, int i, int begin, int end) {
+    int width = table.width;
+    int row_words = table.row_words;
+    int last_bit = (width - 1) & 63;
+    const uint64_t *a = table_row(table, i - 1);
+    const uint64_t *b = table_row(table, i);
+    const uint64_t *c = table_row(table, i + 1);
+    uint64_t *next = table_row(next_table, i);
+    uint64_t wa = (table.west[i - 1] >> table.west_bit) & 1, ea = table.east[i - 1] & 1;
+    uint64_t wb = (table.west[i] >> table.west_bit) & 1, eb = table.east[i] & 1;
+    uint64_t wc = (table.west[i + 1] >> table.west_bit) & 1, ec = table.east[i + 1] & 1;
+    uint64_t changes = 0;
+    if (begin == 0) {
+        life_edge(next[0], west_word(a, 0, wa), a[0], east_word(a, 0, row_words, ea, last_bit),
+                           west_word(b, 0, wb), b[0], east_word(b, 0, row_words, eb, last_bit),
+                           west_word(c, 0, wc), c[0], east_word(c, 0, row_words, ec, last_bit));
+        changes |= next[0] ^ b[0];
+    }
+    changes |= life_row(a, b, c, next, begin > 1 ? begin : 1, end < row_words - 1 ? end : row_words - 1);
+    if (end == row_words) {
+        int k = row_words - 1;
+        if (k > 0) {
+            life_edge(next[k], west_word(a, k, wa), a[k], east_word(a, k, row_words, ea, last_bit),
+                               west_word(b, k, wb), b[k], east_word(b, k, row_words, eb, last_bit),
+                               west_word(c, k, wc), c[k], east_word(c, k, row_words, ec, last_bit));
+        }
+        next[k] &= ~(uint64_t)0 >> (63 - last_bit);
+        changes |= next[k] ^ b[k];
+    }
+    return changes;
+}
+
+// Computes the words word_begin..word_end-1 of the rows begin..end-1 of
+// next_table tile by tile, returns whether any cell changed.
+bool iterate_rows(const bit_table& table, bit_table& next_table, int begin, int end, int word_begin, int word_end) {
+    if (table.width == 0) {
+        return false;
+    }
+    uint64_t changes = 0;
+    for (int k = word_begin; k < word_end; k += TILE_WORDS) {
+        int k_end = k + TILE_WORDS < word_end ? k + TILE_WORDS : word_end;
+        for (int i = begin; i < end; ++i) {
+            changes |= iterate_words(table, next_table, i, k, k_end);
+        }
+    }
+    return changes != 0;
+}
+
+// Computes the words word_begin..word_end-1 of the rows begin..end-1 of
+// next_table. Every thread takes one block of rows, so the blocks only share
+// the rows at their borders.
+void iterate(const bit_table& table, bit_table& next_table, int begin, int end, int word_begin, int word_end) {
+    int rows = end - begin;
+#pragma omp parallel for num_threads(thread_count) schedule(static, 1)
+    for (int block = 0; block < thread_count; ++block) {
+        iterate_rows(table, next_table, begin + (long long)rows * block / thread_count, begin + (long long)rows * (block + 1) / thread_count, word_begin, word_end);
+    }
+}
+
+// Marks the tiles to recompute: those with a neighbour that changed in the
+// last generation. Without blocks to the left and right a row wraps around
+// within the block, so do the tiles.
+void find_active(activity& act, const grid& g) {
+    if (!act.enabled) {
+        return;
+    }
+    for (int r = 0; r < act.rows; ++r) {
+        for (int c = 0; c < act.cols; ++c) {
+            char active = 0;
+            for (int dr = -1; dr <= 1; ++dr) {
+                for (int dc = -1; dc <= 1; ++dc) {
+                    int rr = r + dr;
+                    int cc = c + dc;
+                    if (g.dims[1] == 1) {
+                        cc = (cc + act.cols) % act.cols;
+                    }
+                    if (rr >= 0 && rr < act.rows && cc >= 0 && cc < act.cols) {
+                        active |= act.changed[rr * act.cols + cc];
                     }
-                } else if (line[i] != ',') {
-                    std::cerr << "Incorrect CSV field" << std::endl;
-                    exit(1);
                 }
             }
-        } else {
-            if (line.size() + 1 < 2 * width) {
-                std::cerr << "Incorrect CSV field" << std::endl;
-                exit(1);
-            }
-            for (int i = 0; i < 2 * width - 1; ++i) {
-                if (i % 2 == 0) {
-                    if (line[i] == '0') {
-                        table.push_back(0);
-                    } else if (line[i] == '1') {
-                        table.push_back(1);
-                    } else {
-                        std::cerr << "Incorrect CSV field" << std::endl;
-                        exit(1);
-                    }
-                } else if (line[i] != ',') {
-                    std::cerr << "Incorrect CSV field" << std::endl;
-                    exit(1);
+            act.active[r * act.cols + c] = active;
+        }
+    }
+}
+
+void activate_tile(activity& act, int r, int c) {
+    if (r >= 0 && r < act.rows && c >= 0 && c < act.cols) {
+        act.active[r * act.cols + c] = 1;
+    }
+}
+
+// Marks the border tiles next to ghost cells that changed since the last
+// generation: the ghost rows just above and below the owned rows and the cells
+// west and east of them.
+void mark_ghost_changes(activity& act, const bit_table& table) {
+    if (!act.enabled) {
+        return;
+    }
+    int height = table.height;
+    int row_words = table.row_words;
+    int halo = table.halo;
+    const uint64_t *top = table_row(table, halo - 1);
+    const uint64_t *bottom = table_row(table, height - halo);
+    for (int k = 0; k < row_words; ++k) {
+        for (int kk = k - 1; kk <= k + 1; ++kk) { // the carries reach the neighbour words
+            if (!act.primed || top[k] != act.top[k]) {
+                activate_tile(act, 0, kk / ACTIVE_TILE_WORDS);
+            }
+            if (!act.primed || bottom[k] != act.bottom[k]) {
+                activate_tile(act, act.rows - 1, kk / ACTIVE_TILE_WORDS);
+            }
+        }
+    }
+    act.top.assign(top, top + row_words);
+    act.bottom.assign(bottom, bottom + row_words);
+    act.west.resize(height);
+    act.east.resize(height);
+    for (int i = halo - 1; i <= height - halo; ++i) {
+        uint64_t west = (table.west[i] >> table.west_bit) & 1;
+        uint64_t east = table.east[i] & 1;
+        for (int ii = i - 1; ii <= i + 1; ++ii) {
+            if (ii < halo || ii >= height - halo) {
+                continue;
+            }
+            if (!act.primed || west != act.west[i]) {
+                activate_tile(act, (ii - halo) / ACTIVE_TILE_ROWS, 0);
+            }
+            if (!act.primed || east != act.east[i]) {
+                activate_tile(act, (ii - halo) / ACTIVE_TILE_ROWS, act.cols - 1);
+            }
+        }
+        act.west[i] = west;
+        act.east[i] = east;
+    }
+    act.primed = true;
+}
+
+// Computes the part of the owned rows begin..end-1 and words
+// word_begin..word_end-1 that lies in active tiles.
+void iterate_tiles(const bit_table& table, bit_table& next_table, activity& act, int begin, int end, int word_begin, int word_end) {
+    if (!act.enabled) {
+        iterate(table, next_table, begin, end, word_begin, word_end);
+        return;
+    }
+    if (begin >= end || word_begin >= word_end) {
+        return;
+    }
+    int halo = table.halo;
+    int first_row = (begin - halo) / ACTIVE_TILE_ROWS;
+    int first_col = word_begin / ACTIVE_TILE_WORDS;
+    int cols = (word_end - 1) / ACTIVE_TILE_WORDS + 1 - first_col;
+    int tiles = ((end - 1 - halo) / ACTIVE_TILE_ROWS + 1 - first_row) * cols;
+#pragma omp parallel for num_threads(thread_count) schedule(dynamic, 16)
+    for (int t = 0; t < tiles; ++t) {
+        int r = first_row + t / cols;
+        int c = first_col + t % cols;
+        int tile = r * act.cols + c;
+        if (!act.active[tile]) {
+            continue;
+        }
+        int i = std::max(begin, halo + r * ACTIVE_TILE_ROWS);
+        int i_end = std::min(end, halo + (r + 1) * ACTIVE_TILE_ROWS);
+        int k = std::max(word_begin, c * ACTIVE_TILE_WORDS);
+        int k_end = std::min(word_end, (c + 1) * ACTIVE_TILE_WORDS);
+        if (iterate_rows(table, next_table, i, i_end, k, k_end)) {
+            act.next_changed[tile] = 1;
+        }
+    }
+}
+
+void finish_activity(activity& act) {
+    if (act.enabled) {
+        act.changed.swap(act.next_changed);
+        std::fill(act.next_changed.begin(), act.next_changed.end(), 0);
+    }
+}
+
+// Bands the inner rows are split into while the ghost rows are in flight, MPI
+// is polled between them so large messages keep moving.
+const int PROGRESS_BANDS = 8;
+
+// Adds sign times row i of the table to the column sums.
+inline void add_row(std::vector<int>& column, const bit_table& table, int i, int sign) {
+    const uint64_t *cells = table_row(table, i);
+    for (int k = 0; k < table.row_words; ++k) {
+        for (uint64_t word = cells[k]; word; word &= word - 1) {
+            column[64 * k + __builtin_ctzll(word)] += sign;
+        }
+    }
+}
+
+// The lattice engine runs the Generations and Larger than Life rules cell by
+// cell. The live cells of the box around a cell are summed with sliding
+// windows, down the columns and then along the row, so a cell costs the same
+// whatever the radius. Computes the rows begin..end-1 from the radius rows
+// around them. The blocks span the whole width, the rows wrap around.
+void iterate_lattice_rows(const bit_table& table, bit_table& next_table, int begin, int end) {
+    if (begin >= end) {
+        return;
+    }
+    int radius = rule.radius;
+    int width = table.width;
+    bool aging = !table.age.empty();
+    std::vector<int> column(width); // live cells of the column in rows i-radius..i+radius
+    for (int i = begin - radius; i <= begin + radius; ++i) {
+        add_row(column, table, i, 1);
+    }
+    for (int i = begin; i < end; ++i) {
+        if (i > begin) {
+            add_row(column, table, i + radius, 1);
+            add_row(column, table, i - radius - 1, -1);
+        }
+        const uint64_t *cells = table_row(table, i);
+        uint64_t *next = table_row(next_table, i);
+        const uint8_t *age = aging ? &table.age[(size_t)i * width] : 0;
+        uint8_t *next_age = aging ? &next_table.age[(size_t)i * width] : 0;
+        int sum = 0;
+        for (int j = -radius; j <= radius; ++j) {
+            sum += column[(j + width) % width];
+        }
+        uint64_t word = 0;
+        for (int j = 0; j < width; ++j) {
+            if (j > 0) {
+                int enter = j + radius;
+                int leave = j - radius - 1;
+                sum += column[enter < width ? enter : enter - width] - column[leave >= 0 ? leave : leave + width];
+            }
+            int state;
+            if (cells[j >> 6] >> (j & 63) & 1) {
+                state = survives_at[sum] ? 1 : (rule.states > 2 ? 2 : 0);
+            } else if (aging && age[j]) {
+                state = age[j] + 1 < rule.states ? age[j] + 1 : 0;
+            } else {
+                state = born_at[sum];
+            }
+            word |= (uint64_t)(state == 1) << (j & 63);
+            if (aging) {
+                next_age[j] = state > 1 ? state : 0;
+            }
+            if ((j & 63) == 63 || j == width - 1) {
+                next[j >> 6] = word;
+                word = 0;
+            }
+        }
+    }
+}
+
+void iterate_lattice(const bit_table& table, bit_table& next_table, int begin, int end) {
+    int rows = end - begin;
+#pragma omp parallel for num_threads(thread_count) schedule(static, 1)
+    for (int block = 0; block < thread_count; ++block) {
+        iterate_lattice_rows(table, next_table, begin + (long long)rows * block / thread_count, begin + (long long)rows * (block + 1) / thread_count);
+    }
+}
+
+// One generation of the lattice engine. A generation takes radius rows of
+// the ghost rows, so they are exchanged every halo / radius generations. The
+// rows at least radius rows away from the ghost rows are computed while they
+// come.
+double step_lattice(bit_table& table, bit_table& next_table, const grid& g, int phase, activity& act) {
+    int radius = rule.radius;
+    int height = table.height;
+    int halo = table.halo;
+    int begin = radius * (phase + 1);
+    int end = height - radius * (phase + 1);
+    if (phase > 0) {
+        iterate_lattice(table, next_table, begin, end);
+        return 0;
+    }
+    exchange ex;
+    send_borders(table, g, ex, act);
+    int inner_begin = halo + radius;
+    int inner_end = height - halo - radius;
+    int rows = inner_end - inner_begin;
+    for (int band = 0; band < PROGRESS_BANDS && rows > 0; ++band) {
+        iterate_lattice(table, next_table, inner_begin + rows * band / PROGRESS_BANDS, inner_begin + rows * (band + 1) / PROGRESS_BANDS);
+        poll_borders(ex);
+    }
+    if (rows <= 0) {
+        inner_begin = inner_end = end;
+    }
+    double wait_start = MPI_Wtime();
+    wait_borders(table, g, ex, act);
+    double waited = MPI_Wtime() - wait_start;
+    add_trace("ghost wait", wait_start, wait_start + waited, -1);
+    iterate_lattice(table, next_table, begin, inner_begin);
+    iterate_lattice(table, next_table, inner_end, end);
+    return waited;
+}
+
+// One generation of a block. phase counts the generations since the ghost
+// rows were exchanged, the rows phase+1..height-2-phase are computed from the
+// rows around them, a band that shrinks to the owned rows at phase halo-1.
+// The exchange happens at phase 0. The rows that do not depend on the ghost
+// rows are computed while the ghost cells are exchanged, the first and the last
+// halo owned rows are finished after the exchange. With blocks to the left and
+// right the first and last words of every row wait for the ghost columns too.
+// Ghost rows are always computed, owned rows only in active tiles.
+// Returns the time spent waiting for the ghost cells.
+double step(bit_table& table, bit_table& next_table, const grid& g, int phase, activity& act) {
+    if (extended_rule(rule)) {
+        return step_lattice(table, next_table, g, phase, act);
+    }
+    exchange ex;
+    int height = table.height;
+    int row_words = table.row_words;
+    int halo = table.halo;
+    if (phase > 0) {
+        if (g.dims[1] == 1) {
+            wrap_columns(table, phase, height - phase);
+        }
+        find_active(act, g);
+        mark_ghost_changes(act, table);
+        iterate(table, next_table, phase + 1, halo, 0, row_words);
+        iterate(table, next_table, height - halo, height - 1 - phase, 0, row_words);
+        iterate_tiles(table, next_table, act, halo, height - halo, 0, row_words);
+        finish_activity(act);
+        return 0;
+    }
+    int inner_begin = g.dims[1] > 1 ? 1 : 0;
+    int inner_end = std::max(row_words - inner_begin, inner_begin);
+    send_borders(table, g, ex, act);
+    find_active(act, g);
+    int rows = height - 2 - 2 * halo;
+    for (int band = 0; band < PROGRESS_BANDS && rows > 0; ++band) {
+        iterate_tiles(table, next_table, act, halo + 1 + rows * band / PROGRESS_BANDS, halo + 1 + rows * (band + 1) / PROGRESS_BANDS, inner_begin, inner_end);
+        poll_borders(ex);
+    }
+    double wait_start = MPI_Wtime();
+    wait_borders(table, g, ex, act);
+    double waited = MPI_Wtime() - wait_start;
+    add_trace("ghost wait", wait_start, wait_start + waited, -1);
+    mark_ghost_changes(act, table);
+    iterate(table, next_table, 1, halo, 0, row_words);
+    iterate(table, next_table, height - halo, height - 1, 0, row_words);
+    if (rows > 0) {
+        iterate_tiles(table, next_table, act, halo, halo + 1, 0, row_words);
+        iterate_tiles(table, next_table, act, height - 1 - halo, height - halo, 0, row_words);
+        iterate_tiles(table, next_table, act, halo + 1, height - 1 - halo, 0, inner_begin);
+        iterate_tiles(table, next_table, act, halo + 1, height - 1 - halo, inner_end, row_words);
+    } else {
+        iterate_tiles(table, next_table, act, halo, height - halo, 0, row_words);
+    }
+    finish_activity(act);
+    return waited;
+}
+
+// Rows of a band of the temporal blocking, set by --band-rows. Between two
+// exchanges of deep ghost rows a band goes through all the generations the
+// halo allows while it is in the cache, instead of every generation streaming
+// the whole block through memory. 0 turns it off, -1 fits a band and the rows
+// around it in BAND_CACHE_BYTES of both tables.
+int band_rows = -1;
+const size_t BAND_CACHE_BYTES = 1 << 20;
+
+int calc_band_rows(const bit_table& table) {
+    if (band_rows >= 0) {
+        return band_rows;
+    }
+    size_t row_bytes = 2 * table.row_words * sizeof(uint64_t);
+    return std::max(8, (int)(BAND_CACHE_BYTES / std::max(row_bytes, (size_t)1)) - 2 * table.halo);
+}
+
+// Whether a pass over all the tiles costs little next to skipping them: most
+// of the tiles changed in the last generation.
+bool mostly_active(const activity& act) {
+    return !act.enabled || 2 * std::count(act.changed.begin(), act.changed.end(), 1) >= (long)act.changed.size();
+}
+
+// Computes the rows begin..end-1 of next_table, all the tiles of them, and
+// marks the tiles of the owned rows that changed.
+void iterate_marked(const bit_table& table, bit_table& next_table, activity& act, int begin, int end) {
+    int row_words = table.row_words;
+    if (!act.enabled) {
+        iterate(table, next_table, begin, end, 0, row_words);
+        return;
+    }
+    int halo = table.halo;
+    int owned_begin = std::max(begin, halo);
+    int owned_end = std::min(end, table.height - halo);
+    iterate(table, next_table, begin, std::min(end, halo), 0, row_words);
+    iterate(table, next_table, std::max(begin, table.height - halo), end, 0, row_words);
+    for (int i = owned_begin; i < owned_end; ) {
+        int r = (i - halo) / ACTIVE_TILE_ROWS;
+        int i_end = std::min(owned_end, halo + (r + 1) * ACTIVE_TILE_ROWS);
+#pragma omp parallel for num_threads(thread_count) schedule(dynamic, 1)
+        for (int c = 0; c < act.cols; ++c) {
+            if (iterate_rows(table, next_table, i, i_end, c * ACTIVE_TILE_WORDS, std::min(row_words, (c + 1) * ACTIVE_TILE_WORDS))) {
+                act.next_changed[r * act.cols + c] = 1;
+            }
+        }
+        i = i_end;
+    }
+}
+
+// Runs generations generations from phase 0, at most the halo, in one pass.
+// The first one goes as step() does it, around the exchange of the ghost
+// cells, the others in bands of rows: generation k trails generation k-1 by a
+// row, so a band is still in the cache when the next generations read it.
+// Generation k is written to the table of its parity over generation k-2,
+// whose rows are overwritten only once generation k-1 is past them. All the
+// tiles are computed, the changes of the last generation are marked.
+// Returns the time spent waiting for the ghost cells.
+double step_generations(bit_table& table, bit_table& next_table, const grid& g, int generations, activity& act) {
+    double waited = step(table, next_table, g, 0, act);
+    if (generations < 2) {
+        return waited;
+    }
+    bit_table *tables[2] = {&table, &next_table};
+    int height = table.height;
+    int band = std::max(1, calc_band_rows(table));
+    wrap_columns(next_table, 1, height - 1); // deep halos span the whole width
+    std::vector<int> end(generations + 1); // of the rows of every generation computed so far
+    end[1] = height - 1;
+    for (int k = 2; k <= generations; ++k) {
+        end[k] = k;
+    }
+    while (end[generations] < height - generations) {
+        for (int k = 2; k <= generations; ++k) {
+            int target = std::min(height - k, k == 2 ? end[k] + band : end[k - 1] - 1);
+            if (target <= end[k]) {
+                continue;
+            }
+            const bit_table& from = *tables[(k - 1) % 2];
+            bit_table& to = *tables[k % 2];
+            if (k < generations) {
+                iterate(from, to, end[k], target, 0, table.row_words);
+                wrap_columns(to, end[k], target);
+            } else {
+                iterate_marked(from, to, act, end[k], target);
+            }
+            end[k] = target;
+        }
+    }
+    finish_activity(act);
+    act.primed = false; // the ghost rows went through generations unseen
+    return waited;
+}
+
+// Generations that may run in one pass from iteration without passing a
+// multiple of every, which has to be stopped at.
+int generations_to(int iteration, int every) {
+    return every > 0 ? every - iteration % every : INT_MAX;
+}
+
+// Watch for a board that came back, set by --cycle-every: every cycle_every
+// generations the ranks add up a hash of their blocks. A hash met again among
+// the last CYCLE_HISTORY ones means that the board repeats with a period that
+// divides their distance. The generations after it are then hashed one by one
+// until the hash comes back, which gives the period. From then on the game
+// skips whole periods, the board being the same after them. 0 turns the watch
+// off. The hash is a pass over the block of its own, not a part of the row
+// kernels, so it is taken only that rarely.
+int cycle_every = 64;
+const int CYCLE_HISTORY = 32;
+
+struct cycle_watch {
+    std::deque<std::pair<int, uint64_t> > samples; // iteration and hash of the board
+    int probe_from; // iteration whose hash is looked for again, -1 without a probe
+    int probe_lag; // the period divides it
+    uint64_t probe_hash;
+    int period; // 0 until found
+    int found_at; // iteration the period was found at
+    long long skipped; // generations skipped since
+};
+
+void reset_cycle_watch(cycle_watch& cycle) {
+    cycle.samples.clear();
+    cycle.probe_from = -1;
+    cycle.period = 0;
+    cycle.skipped = 0;
+}
+
+inline uint64_t mix_hash(uint64_t x) {
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// Hash of the whole board, the same for any split of it into blocks: the sum
+// of the hashes of the live words and of the dying cells with their places.
+uint64_t board_hash(const bit_table& table, const grid& g) {
+    int halo = table.halo;
+    int rows = table.height - 2 * halo;
+    uint64_t board_words = calc_row_words(g.width);
+    uint64_t hash = 0;
+#pragma omp parallel for num_threads(thread_count) reduction(+:hash)
+    for (int i = 0; i < rows; ++i) {
+        const uint64_t *row = table_row(table, halo + i);
+        uint64_t word = (g.row_begin + i) * board_words + g.word_begin;
+        for (int w = 0; w < table.row_words; ++w) {
+            if (row[w]) {
+                hash += mix_hash(row[w] ^ ((word + w) * 0x9e3779b97f4a7c15ULL));
+            }
+        }
+        if (!table.age.empty()) { // the blocks of these rules span the whole width
+            const uint8_t *age = &table.age[(size_t)(halo + i) * table.width];
+            uint64_t cell = (uint64_t)(g.row_begin + i) * g.width;
+            for (int j = 0; j < table.width; ++j) {
+                if (age[j]) {
+                    hash += mix_hash((cell + j) * 0xc2b2ae3d27d4eb4fULL + age[j]);
                 }
             }
         }
     }
+    MPI_Allreduce(MPI_IN_PLACE, &hash, 1, MPI_UINT64_T, MPI_SUM, control_comm);
+    return hash;
+}
+
+// Generations that may run in one pass from iteration with the watch looking
+// at the board where it has to.
+int watched_generations(const cycle_watch& cycle, int iteration) {
+    if (cycle_every <= 0 || cycle.period) {
+        return INT_MAX;
+    }
+    return cycle.probe_from >= 0 ? 1 : generations_to(iteration, cycle_every);
+}
+
+// Looks at the board of iteration, just computed.
+void watch_cycle(cycle_watch& cycle, const bit_table& table, const grid& g, int iteration) {
+    if (cycle_every <= 0 || cycle.period) {
+        return;
+    }
+    if (cycle.probe_from >= 0) {
+        uint64_t hash = board_hash(table, g);
+        if (hash == cycle.probe_hash) {
+            cycle.period = iteration - cycle.probe_from;
+            cycle.found_at = iteration;
+        } else if (iteration - cycle.probe_from >= cycle.probe_lag) {
+            cycle.probe_from = -1; // two boards with the same hash
+        }
+        return;
+    }
+    if (iteration % cycle_every != 0) {
+        return;
+    }
+    uint64_t hash = board_hash(table, g);
+    for (size_t i = 0; i < cycle.samples.size(); ++i) {
+        if (cycle.samples[i].second == hash) {
+            cycle.probe_from = iteration;
+            cycle.probe_lag = iteration - cycle.samples[i].first;
+            cycle.probe_hash = hash;
+            break;
+        }
+    }
+    cycle.samples.push_back(std::make_pair(iteration, hash));
+    if (cycle.samples.size() > (size_t)CYCLE_HISTORY) {
+        cycle.samples.pop_front();
+    }
+}
+
+// Generations out of at most generations that may be skipped: whole periods,
+// an even number of generations so that the board stays in the table of its
+// parity, with the other table holding the generation before it.
+int cycle_skip(const cycle_watch& cycle, int generations) {
+    if (!cycle.period) {
+        return 0;
+    }
+    int period = cycle.period % 2 ? 2 * cycle.period : cycle.period;
+    return generations / period * period;
+}
+
+// Generations between two looks at the balance of the work, set by
+// --balance-every, 0 keeps the first split of the rows. The rows move when the
+// slowest row of blocks was busy longer than the average by more than
+// balance_threshold, set by --balance-threshold.
+int balance_every = 128;
+double balance_threshold = 0.1;
+
+// Moves the boundaries between the rows of blocks so that each of them would
+// have been busy for the same time, busy being the time this block spent
+// computing since the last look. The rows of a row of blocks are taken to
+// cost the same. A boundary moves at most to the next one, so rows go only to
+// the blocks just above and below, and every block keeps at least halo rows.
+// Returns whether the table was rebuilt, its ghost cells are then stale until
+// the next exchange.
+bool balance_rows(bit_table& table, grid& g, double busy) {
+    int parts = g.dims[0];
+    int workers = parts * g.dims[1];
+    if (parts == 1 || parts > g.height) { // some slabs have no rows to give
+        return false;
+    }
+    double mine[2] = {busy, (double)g.row_begin};
+    std::vector<double> all(2 * workers);
+    MPI_Allgather(mine, 2, MPI_DOUBLE, &all[0], 2, MPI_DOUBLE, g.comm);
+    std::vector<int> begin(parts + 1, g.height);
+    std::vector<double> time(parts, 0);
+    for (int i = 0; i < workers; ++i) { // ranks are laid out row by row
+        int r = i / g.dims[1];
+        time[r] = std::max(time[r], all[2 * i]);
+        begin[r] = (int)all[2 * i + 1];
+    }
+    double total = 0;
+    double slowest = 0;
+    for (int r = 0; r < parts; ++r) {
+        total += time[r];
+        slowest = std::max(slowest, time[r]);
+    }
+    if (total <= 0 || slowest * parts <= total * (1 + balance_threshold)) {
+        return false;
+    }
+    int halo = table.halo;
+    std::vector<int> next(begin);
+    int r = 0;
+    double cost = 0; // of the rows above begin[r]
+    for (int k = 1; k < parts; ++k) {
+        double target = total * k / parts;
+        while (r < parts - 1 && cost + time[r] < target) {
+            cost += time[r];
+            ++r;
+        }
+        int rows = begin[r + 1] - begin[r];
+        next[k] = begin[r] + (time[r] > 0 ? (int)((target - cost) / time[r] * rows + 0.5) : 0);
+        next[k] = std::max(begin[k - 1] + halo, std::min(begin[k + 1] - halo, next[k]));
+        next[k] = std::max(next[k], next[k - 1] + halo);
+    }
+    if (next == begin) {
+        return false;
+    }
+    int old_begin = begin[g.coords[0]];
+    int old_end = begin[g.coords[0] + 1];
+    int new_begin = next[g.coords[0]];
+    int new_end = next[g.coords[0] + 1];
+    int row_words = table.row_words;
+    bit_table moved;
+    resize_table(moved, new_end - new_begin + 2 * halo, table.width);
+    moved.halo = halo;
+    moved.west_bit = table.west_bit;
+    int keep_begin = std::max(old_begin, new_begin);
+    int keep_end = std::min(old_end, new_end);
+    if (keep_begin < keep_end) {
+        std::copy(table_row(table, halo + keep_begin - old_begin), table_row(table, halo + keep_end - old_begin), table_row(moved, halo + keep_begin - new_begin));
+    }
+    MPI_Request requests[4] = {MPI_REQUEST_NULL, MPI_REQUEST_NULL, MPI_REQUEST_NULL, MPI_REQUEST_NULL};
+    if (new_begin < old_begin) {
+        MPI_Irecv(table_row(moved, halo), (old_begin - new_begin) * row_words, MPI_UINT64_T, g.up, DOWN, g.comm, &requests[0]);
+    }
+    if (new_end > old_end) {
+        MPI_Irecv(table_row(moved, halo + old_end - new_begin), (new_end - old_end) * row_words, MPI_UINT64_T, g.down, UP, g.comm, &requests[1]);
+    }
+    if (new_begin > old_begin) {
+        MPI_Isend(table_row(table, halo), (new_begin - old_begin) * row_words, MPI_UINT64_T, g.up, UP, g.comm, &requests[2]);
+    }
+    if (new_end < old_end) {
+        MPI_Isend(table_row(table, halo + new_end - old_begin), (old_end - new_end) * row_words, MPI_UINT64_T, g.down, DOWN, g.comm, &requests[3]);
+    }
+    MPI_Waitall(4, requests, MPI_STATUSES_IGNORE);
+    free_border_plans(); // the tables move
+    table.words.swap(moved.words);
+    table.west.swap(moved.west);
+    table.east.swap(moved.east);
+    table.height = moved.height;
+    g.row_begin = new_begin;
+    MPI_Type_free(&g.column);
+    MPI_Type_vector(new_end - new_begin, 1, row_words, MPI_UINT64_T, &g.column);
+    MPI_Type_commit(&g.column);
+    return true;
+}
+
+// Checkpoint file: this header, then the rows of the board bit-packed as in
+// bit_table, row_words words per row, then for a Generations rule the states
+// of the cells, a byte per cell.
+struct checkpoint_header {
+    char magic[8];
+    int32_t height;
+    int32_t width;
+    int64_t generation;
+    char rule[64];
+};
+
+const char CHECKPOINT_MAGIC[8] = {'L', 'I', 'F', 'E', 'C', 'K', 'P', 'T'};
+
+int checkpoint_every = 0; // generations between automatic checkpoints, set by --checkpoint-every
+std::string checkpoint_file = "life.ckpt"; // set by --checkpoint-file
+
+void init_checkpoint_header(checkpoint_header& header, int height, int width, long long generation) {
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic));
+    header.height = height;
+    header.width = width;
+    header.generation = generation;
+    strncpy(header.rule, rule_name(rule).c_str(), sizeof(header.rule) - 1);
+}
+
+// Rule the board of a checkpoint runs by.
+bool checkpoint_rule(const checkpoint_header& header, life_rule& r) {
+    return parse_rule(std::string(header.rule, strnlen(header.rule, sizeof(header.rule))), r);
+}
+
+bool check_checkpoint_header(const checkpoint_header& header) {
+    life_rule r;
+    return memcmp(header.magic, CHECKPOINT_MAGIC, sizeof(header.magic)) == 0 && header.height > 0 && header.width > 0
+        && header.generation >= 0 && checkpoint_rule(header, r);
+}
+
+// Reads the header of a checkpoint on rank 0, false if it is not one.
+bool read_checkpoint_header(const std::string& name, checkpoint_header& header) {
+    std::ifstream in(name.c_str(), std::ios::binary);
+    return in.read((char *)&header, sizeof(header)) && check_checkpoint_header(header);
+}
+
+// The whole board of rank 0, for the HashLife engine.
+bool save_table_checkpoint(const bit_table& table, const std::string& name, long long generation) {
+    checkpoint_header header;
+    init_checkpoint_header(header, table.height, table.width, generation);
+    std::ofstream out(name.c_str(), std::ios::binary);
+    out.write((const char *)&header, sizeof(header));
+    out.write((const char *)&table.words[0], table.words.size() * sizeof(uint64_t));
+    return (bool)out;
 }
 
-size_t calc_alive_neighbour_count(const std::vector<char>& table, int i, int j, int width) {
-    size_t alive_neighbour_count = 0;
-    alive_neighbour_count += table[(i - 1) * width + (j ? j - 1 : width - 1)];
-    alive_neighbour_count += table[(i - 1) * width + j];
-    alive_neighbour_count += table[(i - 1) * width + (j != width - 1 ? j + 1 : 0)];
-    alive_neighbour_count += table[i * width + (j != width - 1 ? j + 1 : 0)];
-    alive_neighbour_count += table[(i + 1) * width + (j != width - 1 ? j + 1 : 0)];
-    alive_neighbour_count += table[(i + 1) * width + j];
-    alive_neighbour_count += table[(i + 1) * width + (j ? j - 1 : width - 1)];
-    alive_neighbour_count += table[i * width + (j ? j - 1 : width - 1)];
-    return alive_neighbour_count;
+bool load_table_checkpoint(bit_table& table, const std::string& name) {
+    checkpoint_header header;
+    std::ifstream in(name.c_str(), std::ios::binary);
+    if (!in.read((char *)&header, sizeof(header)) || !check_checkpoint_header(header)) {
+        return false;
+    }
+    resize_table(table, header.height, header.width);
+    return (bool)in.read((char *)&table.words[0], table.words.size() * sizeof(uint64_t));
 }
 
-void send_borders(std::vector<char>& table, int rank, int size, int height, int width) {
-    MPI_Status status;
-    int up_rank  = (rank != 1 ? rank - 1 : size - 1);
-    int down_rank = (rank == size - 1 ? 1 : rank + 1);
-    if (size > 2) {
-        MPI_Sendrecv(&table[width], width, MPI_CHAR, up_rank, UP, &table[(height - 1) * width], width, MPI_CHAR, down_rank, UP, MPI_COMM_WORLD, &status);
-        MPI_Sendrecv(&table[(height - 2) * width], width, MPI_CHAR, down_rank, DOWN, &table[0], width, MPI_CHAR, up_rank, DOWN, MPI_COMM_WORLD, &status);
+// Shows each worker the part of the checkpoint file holding its block, a
+// rows x words piece of the height x row_words array after the header.
+void set_block_view(MPI_File file, const bit_table& table, const grid& g) {
+    int rows = table.height - 2 * table.halo;
+    MPI_Datatype block;
+    if (rows > 0 && table.row_words > 0) {
+        int sizes[2] = {g.height, calc_row_words(g.width)};
+        int subsizes[2] = {rows, table.row_words};
+        int starts[2] = {g.row_begin, g.word_begin};
+        MPI_Type_create_subarray(2, sizes, subsizes, starts, MPI_ORDER_C, MPI_UINT64_T, &block);
     } else {
-        for (int j = 0; j < width; ++j) {
-            table[(height - 1) * width + j] = table[width + j];
-            table[j] = table[(height - 2) * width + j];
+        MPI_Type_contiguous(1, MPI_UINT64_T, &block);
+    }
+    MPI_Type_commit(&block);
+    MPI_File_set_view(file, sizeof(checkpoint_header), MPI_UINT64_T, block, "native", MPI_INFO_NULL);
+    MPI_Type_free(&block);
+}
+
+// Opens a checkpoint on every worker and reads its header.
+bool open_checkpoint(MPI_File& file, const std::string& name, MPI_Comm comm, checkpoint_header& header) {
+    if (MPI_File_open(comm, (char *)name.c_str(), MPI_MODE_RDONLY, MPI_INFO_NULL, &file) != MPI_SUCCESS) {
+        return false;
+    }
+    MPI_File_read_at_all(file, 0, &header, sizeof(header), MPI_BYTE, MPI_STATUS_IGNORE);
+    return true;
+}
+
+// The states of the dying cells of a Generations rule follow the rows, a byte
+// per cell. The blocks of these rules span the whole width, so the states of a
+// block are one piece of the file.
+MPI_Offset age_offset(const grid& g) {
+    return sizeof(checkpoint_header) + (MPI_Offset)g.height * calc_row_words(g.width) * sizeof(uint64_t) + (MPI_Offset)g.row_begin * g.width;
+}
+
+void read_checkpoint_block(MPI_File& file, bit_table& table, const grid& g) {
+    int rows = table.height - 2 * table.halo;
+    set_block_view(file, table, g);
+    MPI_File_read_at_all(file, 0, table_row(table, table.halo), rows * table.row_words, MPI_UINT64_T, MPI_STATUS_IGNORE);
+    if (!table.age.empty()) {
+        MPI_File_set_view(file, 0, MPI_BYTE, MPI_BYTE, "native", MPI_INFO_NULL);
+        MPI_File_read_at_all(file, age_offset(g), &table.age[(size_t)table.halo * table.width], rows * table.width, MPI_BYTE, MPI_STATUS_IGNORE);
+    }
+    MPI_File_close(&file);
+}
+
+// Every worker writes its block to the checkpoint at once, the first one the
+// header. The file is written aside and renamed when complete, so a crash
+// leaves the previous checkpoint intact.
+void save_checkpoint(const bit_table& table, const grid& g, const std::string& name, long long generation) {
+    std::string part = name + ".part";
+    MPI_File file;
+    if (MPI_File_open(g.comm, (char *)part.c_str(), MPI_MODE_CREATE | MPI_MODE_WRONLY, MPI_INFO_NULL, &file) != MPI_SUCCESS) {
+        if (g.rank == 0) {
+            std::cerr << "Cannot write " << part << std::endl;
         }
+        return;
+    }
+    MPI_File_set_size(file, 0);
+    if (g.rank == 0) {
+        checkpoint_header header;
+        init_checkpoint_header(header, g.height, g.width, generation);
+        MPI_File_write_at(file, 0, &header, sizeof(header), MPI_BYTE, MPI_STATUS_IGNORE);
+    }
+    int rows = table.height - 2 * table.halo;
+    set_block_view(file, table, g);
+    MPI_File_write_at_all(file, 0, (void *)table_row(table, table.halo), rows * table.row_words, MPI_UINT64_T, MPI_STATUS_IGNORE);
+    if (!table.age.empty()) {
+        MPI_File_set_view(file, 0, MPI_BYTE, MPI_BYTE, "native", MPI_INFO_NULL);
+        MPI_File_write_at_all(file, age_offset(g), (void *)&table.age[(size_t)table.halo * table.width], rows * table.width, MPI_BYTE, MPI_STATUS_IGNORE);
+    }
+    MPI_File_close(&file);
+    if (g.rank == 0) {
+        rename(part.c_str(), name.c_str());
+        std::cout << "Saved iteration " << generation << " to " << name << std::endl;
+    }
+}
+
+// Replaces the board of a running game by a checkpoint of the same board,
+// returns its generation. It goes to the table of its parity.
+int load_checkpoint(bit_table& even_table, bit_table& odd_table, const grid& g, const std::string& name) {
+    MPI_File file;
+    checkpoint_header header;
+    if (!open_checkpoint(file, name, g.comm, header)) {
+        board_error("Cannot open the checkpoint");
     }
+    read_checkpoint_block(file, header.generation % 2 ? odd_table : even_table, g);
+    return header.generation;
 }
 
-void send_msg(msg message, int size) {
-	MPI_Request request;
-	MPI_Ibcast(&message, 1, MPI_INT, 0, MPI_COMM_WORLD, &request); 
+// Name of the board file the ranks load themselves, NO_BOARD for a random
+// board each of them makes up.
+void send_board_name(const std::string& name, board_format format) {
+    int length = name.size();
+    MPI_Bcast(&format, 1, MPI_INT, 0, control_comm);
+    MPI_Bcast(&length, 1, MPI_INT, 0, control_comm);
+    MPI_Bcast((void *)name.data(), length, MPI_CHAR, 0, control_comm);
 }
 
-void send_param(int cnt, int size) {
-    MPI_Bcast(&cnt, 1, MPI_INT, 0, MPI_COMM_WORLD); 
+std::string receive_board_name(int& format) {
+    int length;
+    MPI_Bcast(&format, 1, MPI_INT, 0, control_comm);
+    MPI_Bcast(&length, 1, MPI_INT, 0, control_comm);
+    std::string name(length, ' ');
+    MPI_Bcast(&name[0], length, MPI_CHAR, 0, control_comm);
+    return name;
 }
 
-void send_status(msg message, int size) {
-	MPI_Request request;
-    MPI_Ibcast(&message, 1, MPI_INT, 0, MPI_COMM_WORLD, &request); 
+// Batch mode, set by --input: no commands are read, the board comes from
+// this file, runs for batch_generations and is written every
+// snapshot_every generations and at the end to the directory batch_output.
+std::string batch_input;
+long long batch_generations = 0;
+int snapshot_every = 0;
+std::string batch_output = ".";
+
+// Format of the board given to --input: a checkpoint or a board file.
+int batch_format(const std::string& name) {
+    checkpoint_header header;
+    if (read_checkpoint_header(name, header)) {
+        return CHECKPOINT_BOARD;
+    }
+    int format = board_format_of(name);
+    if (format == NO_BOARD) {
+        board_error("Unknown format of the board file");
+    }
+    return format;
 }
 
-void print_status(std::vector<char>& table, int height, int width, int size) {
-    int iteration;
-	MPI_Bcast(&iteration, 1, MPI_INT, 1, MPI_COMM_WORLD);
-    int mass_count[size];
-	int mass_disp[size];
-    for(int i = 0; i < size - 1; ++i) {
-        mass_disp[i + 1] = height / (size - 1) * i;
-        mass_count[i + 1] = height / (size - 1);
-        if (i < height % (size - 1)) {
-            mass_disp[i + 1] += i;
-            mass_count[i + 1]++;
-        } else {
-            mass_disp[i + 1] += height % (size - 1);
+// Whether every rank gets at least radius rows of a board of height x width
+// and the neighbourhood fits on the board. Rules of radius 1 run on any board,
+// those of a larger radius on slabs of rows, see calc_dims().
+bool board_fits_rule(const life_rule& r, int height, int width, int workers) {
+    if (r.radius <= 1) {
+        return true;
+    }
+    return height / workers >= r.radius && 2 * r.radius + 1 <= height && 2 * r.radius + 1 <= width;
+}
+
+// Size of the board of a board file or a checkpoint, found by this rank alone,
+// and the rule of a checkpoint.
+bool read_board_size(const std::string& name, int format, int& height, int& width, life_rule& r) {
+    if (format == CHECKPOINT_BOARD) {
+        checkpoint_header header;
+        if (!read_checkpoint_header(name, header)) {
+            return false;
         }
-        mass_count[i + 1] *= width;
-        mass_disp[i + 1] *= width;
+        height = header.height;
+        width = header.width;
+        checkpoint_rule(header, r);
+        return true;
     }
-    mass_count[0] = 0;
-    mass_disp[0] = 0;
-    int *buf;
-	MPI_Gatherv(buf, 0, MPI_CHAR, &table[0], mass_count, mass_disp, MPI_CHAR, 0, MPI_COMM_WORLD);
-    std::cout << "Iteration: " << iteration << std::endl;
-    for (int i = 0; i < height; ++i) {
-        for(int j = 0; j < width; ++j) {
-            std::cout << (table[i * width + j] ? 1 : 0) << ' ';
+    board_file f;
+    if (!map_board(f, name)) {
+        return false;
+    }
+    std::vector<long long> first_rows;
+    index_board(f, MPI_COMM_SELF, first_rows);
+    height = f.height;
+    width = f.width;
+    unmap_board(f);
+    return true;
+}
+
+// Makes up the block of the board owned by this rank, or reads it from the
+// board file or the checkpoint, and places the rank on the grid of blocks.
+// The ranks index a CSV or plaintext file together, then each parses its own
+// rows only. A random board is taken from rank 0, the rule of a checkpoint
+// from the checkpoint. Returns the generation of the board.
+int init_table(bit_table& table, grid& g, MPI_Comm comm, const std::string& name, int format, random_board random) {
+    int height;
+    int width;
+    int workers;
+    int dims[2];
+    int generation = 0;
+    board_file f;
+    std::vector<long long> first_rows;
+    MPI_File file;
+    if (format == CHECKPOINT_BOARD) {
+        checkpoint_header header;
+        if (!open_checkpoint(file, name, comm, header)) {
+            board_error("Cannot open the checkpoint");
         }
-        std::cout << std::endl;
+        height = header.height;
+        width = header.width;
+        generation = header.generation;
+        checkpoint_rule(header, rule);
+    } else if (format != NO_BOARD) {
+        if (!map_board(f, name)) {
+            board_error("Cannot open the board file");
+        }
+        index_board(f, comm, first_rows);
+        height = f.height;
+        width = f.width;
+    } else {
+        MPI_Bcast(&random, sizeof(random), MPI_BYTE, 0, control_comm);
+        height = random.height;
+        width = random.width;
     }
+    MPI_Comm_size(comm, &workers);
+    calc_dims(workers, height, width, halo_depth, dims);
+    int row_begin, rows, word_begin, words;
+    MPI_Comm_rank(comm, &g.rank);
+    calc_block(height, width, dims, g.rank, row_begin, rows, word_begin, words);
+    int block_width = width - 64 * word_begin < 64 * words ? width - 64 * word_begin : 64 * words;
+    int radius = rule.radius; // the board fits it, see board_fits_rule()
+    int halo = radius * std::max(1, std::min(halo_depth, height / dims[0] / radius)); // the ghost rows come from one neighbour
+    free_border_plans();
+    resize_table(table, rows + 2 * halo, block_width);
+    table.halo = halo;
+    init_ages(table);
+    create_grid(g, comm, dims, rows, words);
+    skip_empty_slabs(g, height);
+    g.height = height;
+    g.width = width;
+    g.row_begin = row_begin;
+    g.word_begin = word_begin;
+    table.west_bit = g.coords[1] == 0 ? (width - 1) & 63 : 63; // only the last block of a row ends inside a word
+    if (format == CHECKPOINT_BOARD) {
+        read_checkpoint_block(file, table, g);
+    } else if (format != NO_BOARD) {
+        read_board(f, first_rows, table, halo, row_begin, rows, 64 * word_begin, block_width);
+        unmap_board(f);
+    } else {
+        fill_random_rows(table, random, halo, rows, row_begin, 64 * word_begin);
+    }
+    return generation;
 }
 
-void print_iteration() {
-    int iteration;
-    MPI_Bcast(&iteration, 1, MPI_INT, 1, MPI_COMM_WORLD);
-    std::cout << "Iteration: " << iteration << std::endl;
+// HashLife engine, run by rank 0 alone. The board is a quadtree of
+// hash-consed nodes, a node of level k is a 2^k x 2^k square made of four
+// nodes of level k-1, the two nodes of level 0 are the dead and the live cell.
+// The result of a node, its center square 2^j generations later, is memoized,
+// so a board made of repeating parts advances exponentially many generations
+// per step.
+struct hash_node {
+    int nw, ne, sw, se;
+    int level;
+};
+
+struct hashlife {
+    std::vector<hash_node> nodes;
+    std::vector<int> slots; // open addressing table of the nodes, -1 is free
+    std::vector<int> empty; // the empty node of every level
+    std::unordered_map<uint64_t, int> results; // node * 64 + j -> its center 2^j generations later
+    std::unordered_map<uint64_t, int> built; // windows of the board built by hash_build()
+    int root;
+    long long iteration;
+    double run_time;
+};
+
+size_t hash_node_limit = 1 << 22; // nodes kept by the garbage collector, set by --hash-nodes
+
+inline size_t hash_slot(const hashlife& hl, int nw, int ne, int sw, int se) {
+    uint64_t key = ((uint64_t)(uint32_t)nw * 0x9e3779b97f4a7c15ULL) ^ ((uint64_t)(uint32_t)ne * 0xc2b2ae3d27d4eb4fULL)
+                 ^ ((uint64_t)(uint32_t)sw * 0x165667b19e3779f9ULL) ^ ((uint64_t)(uint32_t)se * 0x27d4eb2f165667c5ULL);
+    return (key ^ (key >> 29)) & (hl.slots.size() - 1);
 }
 
-void iterate(std::vector<char>& table, std::vector<char>& next_table, int height, int width) {
-    for(int i = 1; i < height - 1; ++i) {
-        for(int j = 0; j < width; ++j) {
-            size_t alive_neighbour_count = calc_alive_neighbour_count(table, i, j, width);
-            if (table[i * width +j]) {
-                if (alive_neighbour_count == 2 || alive_neighbour_count == 3) {
-                    next_table[i * width +j] = 1;
-                } else {
-                    next_table[i * width +j] = 0;
-                }
-            } else {
-                if (alive_neighbour_count == 3) {
-                    next_table[i * width +j] = 1;
-                } else {
-                    next_table[i * width +j] = 0;
+void hash_rehash(hashlife& hl, size_t slots) {
+    hl.slots.assign(slots, -1);
+    for (size_t n = 2; n < hl.nodes.size(); ++n) {
+        const hash_node& node = hl.nodes[n];
+        size_t s = hash_slot(hl, node.nw, node.ne, node.sw, node.se);
+        while (hl.slots[s] != -1) {
+            s = (s + 1) & (slots - 1);
+        }
+        hl.slots[s] = n;
+    }
+}
+
+// The node made of four nodes of the same level.
+int hash_join(hashlife& hl, int nw, int ne, int sw, int se) {
+    size_t s = hash_slot(hl, nw, ne, sw, se);
+    while (hl.slots[s] != -1) {
+        const hash_node& node = hl.nodes[hl.slots[s]];
+        if (node.nw == nw && node.ne == ne && node.sw == sw && node.se == se) {
+            return hl.slots[s];
+        }
+        s = (s + 1) & (hl.slots.size() - 1);
+    }
+    hash_node node = {nw, ne, sw, se, hl.nodes[nw].level + 1};
+    hl.nodes.push_back(node);
+    hl.slots[s] = hl.nodes.size() - 1;
+    if (2 * hl.nodes.size() > hl.slots.size()) {
+        hash_rehash(hl, 2 * hl.slots.size());
+    }
+    return hl.nodes.size() - 1;
+}
+
+int hash_empty(hashlife& hl, int level) {
+    while ((int)hl.empty.size() <= level) {
+        int e = hl.empty.back();
+        hl.empty.push_back(hash_join(hl, e, e, e, e));
+    }
+    return hl.empty[level];
+}
+
+void init_hashlife(hashlife& hl) {
+    hash_node cell = {0, 0, 0, 0, 0};
+    hl.nodes.assign(2, cell);
+    hl.slots.assign(1 << 16, -1);
+    hl.empty.assign(1, 0);
+    hl.results.clear();
+    hl.built.clear();
+    hl.root = 0;
+    hl.iteration = 0;
+    hl.run_time = 0;
+}
+
+// Center square of level k-1 of a node of level k.
+int hash_center(hashlife& hl, int n) {
+    hash_node node = hl.nodes[n];
+    return hash_join(hl, hl.nodes[node.nw].se, hl.nodes[node.ne].sw, hl.nodes[node.sw].ne, hl.nodes[node.se].nw);
+}
+
+// Center square of level k-1 of a node of level k, 2^j generations later,
+// j <= k-2. A node of level 2 is computed cell by cell. Above it the node is
+// cut into nine overlapping squares of level k-1 whose centers, advanced by
+// 2^(k-3) generations at full speed or not at all when j is smaller, are joined
+// into four squares advanced by the rest of the generations.
+int hash_advance(hashlife& hl, int n, int j) {
+    hash_node node = hl.nodes[n];
+    int k = node.level;
+    if (n == hash_empty(hl, k)) {
+        return hash_empty(hl, k - 1);
+    }
+    uint64_t key = (uint64_t)n * 64 + j;
+    std::unordered_map<uint64_t, int>::iterator found = hl.results.find(key);
+    if (found != hl.results.end()) {
+        return found->second;
+    }
+    int result;
+    if (k == 2) {
+        int quads[4] = {node.nw, node.ne, node.sw, node.se};
+        char cells[4][4];
+        for (int q = 0; q < 4; ++q) {
+            hash_node quad = hl.nodes[quads[q]];
+            int y = q / 2 * 2, x = q % 2 * 2;
+            cells[y][x] = quad.nw;
+            cells[y][x + 1] = quad.ne;
+            cells[y + 1][x] = quad.sw;
+            cells[y + 1][x + 1] = quad.se;
+        }
+        int next[4];
+        for (int c = 0; c < 4; ++c) {
+            int y = 1 + c / 2, x = 1 + c % 2;
+            int neighbours = 0;
+            for (int dy = -1; dy <= 1; ++dy) {
+                for (int dx = -1; dx <= 1; ++dx) {
+                    neighbours += (dy || dx) ? cells[y + dy][x + dx] : 0;
                 }
             }
+            next[c] = (cells[y][x] ? rule.survival : rule.birth) >> neighbours & 1;
+        }
+        result = hash_join(hl, next[0], next[1], next[2], next[3]);
+    } else {
+        hash_node a = hl.nodes[node.nw], b = hl.nodes[node.ne], c = hl.nodes[node.sw], d = hl.nodes[node.se];
+        int squares[9] = {
+            node.nw, hash_join(hl, a.ne, b.nw, a.se, b.sw), node.ne,
+            hash_join(hl, a.sw, a.se, c.nw, c.ne), hash_join(hl, a.se, b.sw, c.ne, d.nw), hash_join(hl, b.sw, b.se, d.nw, d.ne),
+            node.sw, hash_join(hl, c.ne, d.nw, c.se, d.sw), node.se};
+        bool full = j == k - 2;
+        for (int s = 0; s < 9; ++s) {
+            squares[s] = full ? hash_advance(hl, squares[s], k - 3) : hash_center(hl, squares[s]);
         }
+        int rest = full ? k - 3 : j;
+        int nw = hash_advance(hl, hash_join(hl, squares[0], squares[1], squares[3], squares[4]), rest);
+        int ne = hash_advance(hl, hash_join(hl, squares[1], squares[2], squares[4], squares[5]), rest);
+        int sw = hash_advance(hl, hash_join(hl, squares[3], squares[4], squares[6], squares[7]), rest);
+        int se = hash_advance(hl, hash_join(hl, squares[4], squares[5], squares[7], squares[8]), rest);
+        result = hash_join(hl, nw, ne, sw, se);
     }
+    hl.results[key] = result;
+    return result;
 }
 
-void send_table(std::vector<char>& table, int height, int width, int size) { //    
-	int mass_count[size]; //   
-	int mass_disp[size]; //  
-    for(int i = 0; i < size - 1; ++i) { //  
-        mass_disp[i + 1] = height / (size - 1) * i;
-        mass_count[i + 1] = height / (size - 1);
-        if (i < height % (size - 1)) {
-            mass_disp[i + 1] += i;
-            mass_count[i + 1]++;
-        } else {
-            mass_disp[i + 1] += height % (size - 1);
-        }
-        mass_count[i + 1] *= width;
-        mass_disp[i + 1] *= width;
-    }
-    mass_count[0] = 0;
-    mass_disp[0] = 0;
-    int *recv;
-    MPI_Bcast(&width, 1, MPI_INT, 0, MPI_COMM_WORLD); //       
-    MPI_Bcast(&mass_count[0], size, MPI_INT, 0, MPI_COMM_WORLD);
-    MPI_Bcast(&mass_disp[0], size, MPI_INT, 0, MPI_COMM_WORLD);
-    MPI_Scatterv(&table[0], mass_count, mass_disp, MPI_CHAR, recv, 0, MPI_CHAR, 0, MPI_COMM_WORLD); //    
-}
-
-void init_table(std::vector<char>& table, int& height, int& width, int size, int rank) { 
-    MPI_Status status;
-    int mass_count[size];
-	int mass_disp[size];
-	int *buf;
-    MPI_Bcast(&width, 1, MPI_INT, 0, MPI_COMM_WORLD);
-    MPI_Bcast(&mass_count[0], size, MPI_INT, 0, MPI_COMM_WORLD);
-    MPI_Bcast(&mass_disp[0], size, MPI_INT, 0, MPI_COMM_WORLD);
-    height = 2 + mass_count[rank] / width;
-    table.resize(height * width);
-    MPI_Scatterv(buf, mass_count, mass_disp, MPI_CHAR, &table[width], mass_count[rank], MPI_CHAR, 0, MPI_COMM_WORLD);
-}
-
-void master(int size) 
-{
-    std::vector<char> table;
-    int width, height;
-    bool started = false;
-    msg st = WAIT; //   
-    std::string cmd;
-    while(std::cin >> cmd)  {
-        if (cmd == "START") {
-            if (started) {
+// 2^level mod m.
+int pow2_mod(int level, int m) {
+    long long power = 1 % m;
+    for (int i = 0; i < level; ++i) {
+        power = power * 2 % m;
+    }
+    return power;
+}
+
+// Square of level k of the board repeated over the plane, its corner cell is
+// cell (i, j) of the board. The squares are memoized by the corner, a board
+// whose sides are powers of two has a single square of every level above them.
+int hash_build(hashlife& hl, const bit_table& table, int level, int i, int j) {
+    if (level == 0) {
+        return get_cell(table, i, j);
+    }
+    uint64_t key = ((uint64_t)level << 58) | ((uint64_t)i << 29) | j;
+    std::unordered_map<uint64_t, int>::iterator found = hl.built.find(key);
+    if (found != hl.built.end()) {
+        return found->second;
+    }
+    int i2 = (i + pow2_mod(level - 1, table.height)) % table.height;
+    int j2 = (j + pow2_mod(level - 1, table.width)) % table.width;
+    int nw = hash_build(hl, table, level - 1, i, j);
+    int ne = hash_build(hl, table, level - 1, i, j2);
+    int sw = hash_build(hl, table, level - 1, i2, j);
+    int se = hash_build(hl, table, level - 1, i2, j2);
+    int n = hash_join(hl, nw, ne, sw, se);
+    hl.built[key] = n;
+    return n;
+}
+
+// Writes the live cells of the square of node n with the corner (i, j), which
+// lie in the first height rows and width columns, to the board, shifted by
+// (shift_i, shift_j) around the torus.
+void hash_extract(hashlife& hl, bit_table& table, int n, long long i, long long j, int shift_i, int shift_j) {
+    hash_node node = hl.nodes[n];
+    if (i >= table.height || j >= table.width || n == hash_empty(hl, node.level)) {
+        return;
+    }
+    if (node.level == 0) {
+        set_cell(table, (i + shift_i) % table.height, (j + shift_j) % table.width, 1);
+        return;
+    }
+    long long half = 1LL << (node.level - 1);
+    hash_extract(hl, table, node.nw, i, j, shift_i, shift_j);
+    hash_extract(hl, table, node.ne, i, j + half, shift_i, shift_j);
+    hash_extract(hl, table, node.sw, i + half, j, shift_i, shift_j);
+    hash_extract(hl, table, node.se, i + half, j + half, shift_i, shift_j);
+}
+
+void hash_mark(const hashlife& hl, std::vector<char>& marked, int n) {
+    std::vector<int> stack(1, n);
+    while (!stack.empty()) {
+        int m = stack.back();
+        stack.pop_back();
+        if (marked[m]) {
+            continue;
+        }
+        marked[m] = 1;
+        if (hl.nodes[m].level > 0) {
+            stack.push_back(hl.nodes[m].nw);
+            stack.push_back(hl.nodes[m].ne);
+            stack.push_back(hl.nodes[m].sw);
+            stack.push_back(hl.nodes[m].se);
+        }
+    }
+}
+
+// Garbage collection once the nodes outgrow hash_node_limit: keeps the last
+// board and the results reachable from it, or the board alone if they do not
+// fit in half of the limit either. Children are always older than their
+// parent, so the nodes are compacted in place in a single pass.
+void hash_collect(hashlife& hl) {
+    if (hl.nodes.size() <= hash_node_limit) {
+        return;
+    }
+    std::vector<char> marked(hl.nodes.size(), 0);
+    hash_mark(hl, marked, hl.root);
+    for (size_t k = 0; k < hl.empty.size(); ++k) {
+        hash_mark(hl, marked, hl.empty[k]);
+    }
+    std::vector<char> board = marked;
+    bool grown = true;
+    while (grown) {
+        grown = false;
+        for (std::unordered_map<uint64_t, int>::iterator r = hl.results.begin(); r != hl.results.end(); ++r) {
+            if (marked[r->first / 64] && !marked[r->second]) {
+                hash_mark(hl, marked, r->second);
+                grown = true;
+            }
+        }
+    }
+    if ((size_t)std::count(marked.begin(), marked.end(), 1) > hash_node_limit / 2) {
+        marked = board;
+    }
+    std::vector<int> index(hl.nodes.size(), -1);
+    size_t kept = 0;
+    for (size_t n = 0; n < hl.nodes.size(); ++n) {
+        if (n < 2 || marked[n]) {
+            hash_node node = hl.nodes[n];
+            if (node.level > 0) {
+                node.nw = index[node.nw];
+                node.ne = index[node.ne];
+                node.sw = index[node.sw];
+                node.se = index[node.se];
+            }
+            index[n] = kept;
+            hl.nodes[kept++] = node;
+        }
+    }
+    hl.nodes.resize(kept);
+    std::unordered_map<uint64_t, int> results;
+    for (std::unordered_map<uint64_t, int>::iterator r = hl.results.begin(); r != hl.results.end(); ++r) {
+        if (marked[r->first / 64] && marked[r->second]) {
+            results[(uint64_t)index[r->first / 64] * 64 + r->first % 64] = index[r->second];
+        }
+    }
+    hl.results.swap(results);
+    for (size_t k = 0; k < hl.empty.size(); ++k) {
+        hl.empty[k] = index[hl.empty[k]];
+    }
+    hl.root = index[hl.root];
+    size_t slots = 1 << 16;
+    while (slots < 2 * kept) {
+        slots *= 2;
+    }
+    hash_rehash(hl, slots);
+}
+
+// Advances the board by count generations, one power of two at a time. The
+// board repeats over the plane, the square of level k >= j+2 with its corner
+// at cell (0, 0) is built and its center advanced by 2^j generations. That
+// center, at least as large as the board, holds every cell of it once within
+// its first rows and columns.
+void hash_run(hashlife& hl, bit_table& table, long long count) {
+    if (table.width == 0) {
+        hl.iteration += count;
+        return;
+    }
+    int min_level = 2;
+    while ((1LL << (min_level - 1)) < std::max(table.height, table.width)) {
+        ++min_level;
+    }
+    for (int j = 0; count >> j; ++j) {
+        if (!((count >> j) & 1)) {
+            continue;
+        }
+        int level = std::max(j + 2, min_level);
+        hl.built.clear();
+        hl.root = hash_build(hl, table, level, 0, 0);
+        hl.built.clear();
+        int center = hash_advance(hl, hl.root, j);
+        std::fill(table.words.begin(), table.words.end(), 0);
+        hash_extract(hl, table, center, 0, 0, pow2_mod(level - 2, table.height), pow2_mod(level - 2, table.width));
+        hl.iteration += 1LL << j;
+        hash_collect(hl);
+    }
+}
+
+// A command as rank 0 read it, the parameters go to the other ranks after
+// the message.
+struct command {
+    msg message;
+    int count; // generations to RUN
+    std::string name; // board file or checkpoint
+    board_format format;
+    random_board random; // of START h w
+    status_view view;
+};
+
+// What rank 0 knows beyond its block: the size of the board, and the whole
+// board run by the HashLife engine.
+struct master_state {
+    bool started;
+    bool hash_engine; // START HASHLIFE, rank 0 runs the board alone
+    hashlife hl;
+    bit_table board;
+};
+
+// Rank 0 reads lines until a command for all the ranks comes. The commands
+// it answers alone are done here: wrong ones and those of the HashLife engine.
+// A running game gets WAIT when there is no command to take now.
+void read_command(console& c, bool running, master_state& m, command& cmd) {
+    while (true) {
+        cmd.message = WAIT;
+        std::string line = take_line(c, running);
+        if (line.empty()) {
+            return;
+        }
+        std::istringstream in(line);
+        std::string name;
+        in >> name;
+        if (name == "START") {
+            if (m.started) {
                 std::cerr << "The game is already started. Try again." << std::endl;
                 continue;
             }
-            started = true;
             std::string info;
-            std::cin >> info;
-            if (info.find(".csv") != std::string::npos) {
-            	set_csv_table(table, info.c_str(), height, width); 
-                if (height == 0) {
-                    std::cerr << "Empty table found in csv file. Try again." << std::endl;
+            in >> info;
+            bool hash_engine = info == "HASHLIFE"; // START HASHLIFE, rank 0 runs the board alone
+            if (hash_engine) {
+                in >> info;
+            }
+            cmd.format = board_format_of(info);
+            std::string word;
+            bool more; // word is read and not taken yet
+            if (cmd.format != NO_BOARD) {
+                board_file f;
+                if (!map_board(f, info)) {
+                    std::cerr << "Cannot open " << info << ". Try again." << std::endl;
+                    continue;
+                }
+                bool empty = !has_rows(f);
+                unmap_board(f);
+                if (empty) {
+                    std::cerr << "Empty table found in board file. Try again." << std::endl;
                     continue;
                 }
+                if (hash_engine) {
+                    int height, width;
+                    load_table(m.board, info, height, width);
+                }
+                more = (bool)(in >> word);
             } else {
-                int m = 0;
-                for (int i = 0; i < info.size(); ++i) {
-                    if (info[i] < '0' || info[i] > '9') {
-                        std::cerr << "Incorrect arguments of START command. Try again." << std::endl;
-                        continue;
-                    }
-                    m = m * 10 + info[i] - '0';
+                random_board& r = cmd.random;
+                r.density = 0.5;
+                r.seed = 0;
+                r.height = atoi(info.c_str());
+                bool valid = info.find_first_not_of("0123456789") == std::string::npos && r.height > 0 && in >> r.width && r.width > 0;
+                more = valid && in >> word;
+                if (more && word != "RULE") { // the density
+                    char *end;
+                    r.density = strtod(word.c_str(), &end);
+                    valid = *end == 0 && r.density >= 0 && r.density <= 1;
+                    more = valid && in >> word;
                 }
-                int n;
-                std::cin >> n;
-                width = n;
-                height = m;
-                set_random_table(table, m, n);
-            }
-            send_table(table, height, width, size); //    
-        } else if (cmd == "RUN") {
-            int cnt;
-            std::cin >> cnt;
-            st = RUN;
-            send_msg(RUN, size); //     
-            send_param(cnt, size);
-            sleep(5);
-        } else if (cmd == "STATUS") {
-            send_msg(STATUS, size);
-            print_status(table, height, width, size);
-        } else if (cmd == "STOP") {
-            st = STOP;
-            send_msg(STOP, size);
-            print_iteration();
-        } else if (cmd == "TIME") {
-            send_msg(TIME, size);        
-        } else if (cmd == "QUIT") {
-            st = QUIT;
-            send_msg(QUIT, size);
-        } else {
+                if (more && word != "RULE") { // the seed
+                    char *end;
+                    r.seed = strtoull(word.c_str(), &end, 10);
+                    valid = word.find_first_not_of("0123456789") == std::string::npos && *end == 0;
+                    more = valid && in >> word;
+                }
+                if (!valid) {
+                    std::cerr << "Incorrect arguments of START command. Try again." << std::endl;
+                    continue;
+                }
+                if (hash_engine) {
+                    set_random_table(m.board, r);
+                }
+            }
+            life_rule start_rule = rule;
+            if (more && (word != "RULE" || !(in >> word) || !parse_rule(word, start_rule))) {
+                std::cerr << "Incorrect rule of START command. Try again." << std::endl;
+                continue;
+            }
+            if (hash_engine && extended_rule(start_rule)) {
+                std::cerr << "The HashLife engine runs two-state rules of radius 1 only. Try again." << std::endl;
+                continue;
+            }
+            if (start_rule.radius > 1) {
+                int height, width, workers;
+                MPI_Comm_size(MPI_COMM_WORLD, &workers);
+                if (cmd.format == NO_BOARD) {
+                    height = cmd.random.height;
+                    width = cmd.random.width;
+                } else if (!read_board_size(info, cmd.format, height, width, start_rule)) {
+                    height = width = INT_MAX; // init_table() tells what is wrong with the file
+                }
+                if (!board_fits_rule(start_rule, height, width, workers)) {
+                    std::cerr << "The board is too small for the radius of the rule. Try again." << std::endl;
+                    continue;
+                }
+            }
+            rule = start_rule;
+            m.started = true;
+            if (hash_engine) {
+                m.hash_engine = true;
+                init_hashlife(m.hl);
+                continue;
+            }
+            cmd.message = START;
+            cmd.name = info;
+            return;
+        } else if (name == "LOAD") {
+            in >> cmd.name;
+            checkpoint_header header;
+            life_rule load_rule;
+            if (!read_checkpoint_header(cmd.name, header)) {
+                std::cerr << "No checkpoint found in " << cmd.name << ". Try again." << std::endl;
+            } else if (!m.started) {
+                int workers;
+                MPI_Comm_size(MPI_COMM_WORLD, &workers);
+                checkpoint_rule(header, load_rule);
+                if (!board_fits_rule(load_rule, header.height, header.width, workers)) {
+                    std::cerr << "The board is too small for the radius of the rule. Try again." << std::endl;
+                    continue;
+                }
+                m.started = true;
+                cmd.message = START;
+                cmd.format = CHECKPOINT_BOARD;
+                return;
+            } else if (header.height != m.board.height || header.width != m.board.width) {
+                std::cerr << "The checkpoint holds another board. Try again." << std::endl;
+            } else if (checkpoint_rule(header, load_rule) && rule_name(load_rule) != rule_name(rule)) {
+                std::cerr << "The checkpoint runs by another rule. Try again." << std::endl;
+            } else if (m.hash_engine) {
+                load_table_checkpoint(m.board, cmd.name);
+                m.hl.iteration = header.generation;
+            } else {
+                cmd.message = LOAD;
+                return;
+            }
+        } else if (name == "QUIT") {
+            cmd.message = QUIT;
+            return;
+        } else if (name != "RUN" && name != "STATUS" && name != "STOP" && name != "TIME" && name != "SAVE" && name != "STATS") {
             std::cerr << "Incorrect command. Try again" << std::endl;
+        } else if (!m.started) {
+            std::cerr << "The game is not started. Try again." << std::endl;
+        } else if (name == "RUN") {
+            in >> cmd.count;
+            if (m.hash_engine) {
+                double start_time = MPI_Wtime();
+                hash_run(m.hl, m.board, cmd.count);
+                m.hl.run_time = MPI_Wtime() - start_time;
+                continue;
+            }
+            cmd.message = RUN; //     
+            return;
+        } else if (name == "STATUS") {
+            if (!read_status_view(in, m.board.height, m.board.width, cmd.view)) {
+                std::cerr << "Incorrect arguments of STATUS command. Try again." << std::endl;
+                continue;
+            }
+            if (!m.hash_engine) {
+                cmd.message = STATUS;
+                return;
+            }
+            if (cmd.view.mode == STATUS_BOARD) {
+                print_table(m.board, m.hl.iteration);
+            } else if (cmd.view.mode == STATUS_DENSITY) {
+                int bins = (m.board.width + cmd.view.side - 1) / cmd.view.side;
+                std::vector<long long> counts((size_t)((m.board.height + cmd.view.side - 1) / cmd.view.side) * bins);
+                count_density(m.board, 0, m.board.height, 0, 0, cmd.view.side, bins, counts);
+                print_density(counts, m.board.height, m.board.width, cmd.view.side, m.hl.iteration);
+            } else if (cmd.view.mode == STATUS_REGION) {
+                std::vector<cell_run> runs;
+                collect_runs(m.board, 0, 0, m.board.height, 0, 0, cmd.view, runs);
+                print_runs(runs, cmd.view, "Window of generation " + std::to_string(m.hl.iteration), m.hl.iteration);
+            } else {
+                std::cerr << "The HashLife engine keeps no snapshots. Try again." << std::endl;
+            }
+        } else if (name == "STOP") {
+            if (m.hash_engine) {
+                std::cout << "Iteration: " << m.hl.iteration << std::endl;
+                continue;
+            }
+            cmd.message = STOP;
+            return;
+        } else if (name == "TIME") {
+            if (m.hash_engine) {
+                std::cout << "The time is " << m.hl.run_time << " sec"  << std::endl;
+                continue;
+            }
+            cmd.message = TIME;
+            return;
+        } else if (name == "SAVE") {
+            in >> cmd.name;
+            if (m.hash_engine) {
+                if (!save_table_checkpoint(m.board, cmd.name, m.hl.iteration)) {
+                    std::cerr << "Cannot write " << cmd.name << std::endl;
+                }
+                continue;
+            }
+            cmd.message = SAVE;
+            return;
+        } else if (name == "STATS") {
+            if (m.hash_engine) {
+                std::cerr << "The HashLife engine keeps no stats. Try again." << std::endl;
+                continue;
+            }
+            cmd.message = STATS;
+            return;
         }
     }
 }
 
-void worker(int rank, int size) {
+// Checkpoint of the given generation in the batch output directory.
+std::string snapshot_name(int generation) {
+    char name[32];
+    snprintf(name, sizeof(name), "life_%010d.ckpt", generation);
+    return batch_output + "/" + name;
+}
+
+// Run by every rank, each of them owns a block of the board. Rank 0 also
+// reads the commands and prints the answers. Commands are taken when the game
+// is idle and every check_every generations while it runs.
+void game(int rank, int size) {
     msg st = WAIT; //     
-    int width, height;
     int iteration = 0;
     int it_count = 0;
-    double start_time, stop_time; 
-    std::vector<char> odd_table;
-    std::vector<char> even_table;
-    init_table(even_table, height, width, size, rank);
-    odd_table.resize(height * width);
-    MPI_Request request;
-    MPI_Status status;
-    int message;
-    MPI_Ibcast(&message, 1, MPI_INT, 0, MPI_COMM_WORLD, &request); 
+    double start_time = 0, stop_time = 0;
+    bit_table odd_table;
+    bit_table even_table;
+    grid g;
+    activity act;
+    int phase = 0;
+    double busy = 0; // computing since the last look at the balance
+    int balance_at = 0;
+    bool started = false;
+    bool batch = !batch_input.empty(); // runs to the end with no commands
+    double batch_start = MPI_Wtime();
+    console c;
+    master_state m;
+    m.started = m.hash_engine = false;
+    status_snapshot snapshot;
+    snapshot.row_begin = -1;
+    status_output output;
+    output.pending = false;
+    cycle_watch cycle;
+    reset_cycle_watch(cycle);
+    std::thread reader;
+    if (batch) {
+        if (rank == 0) {
+            mkdir(batch_output.c_str(), 0777);
+        }
+    } else if (rank == 0) {
+        reader = std::thread(read_console, &c);
+    }
     while (true) {
-        int flag = 0;
-        if (st == WAIT) {
-            MPI_Test(&request, &flag, &status);
-            while (!flag)
-            {
-                struct timespec tw = {0,1000000};
-                struct timespec tr;
-                nanosleep(&tw, &tr);
-                MPI_Test(&request, &flag, &status);
-            }
-        } else {
-            MPI_Test(&request, &flag, &status);
-        }
-        if (flag) {
-            if (message == RUN) {
-                st = RUN;
-                start_time = MPI_Wtime();
-                int add_it;
-                MPI_Bcast(&add_it, 1, MPI_INT, 0, MPI_COMM_WORLD); 
-                it_count += add_it;
-            } else if (message == QUIT) {
+        command cmd;
+        cmd.message = batch && !started ? START : WAIT;
+        bool running = started && iteration < it_count;
+        if (st == RUN && !running) {
+            stop_time = MPI_Wtime();
+            st = WAIT;
+        }
+        if (batch) {
+            if (started && !running) {
                 break;
-            } else if (message == STOP) {
-                if (st == RUN) {
-                    st = WAIT;
-                    it_count = iteration;
-                    stop_time = MPI_Wtime();
-                }
-                MPI_Bcast(&iteration, 1, MPI_INT, 1, MPI_COMM_WORLD);
-            } 
-			else if (message == STATUS) {
-                MPI_Bcast(&iteration, 1, MPI_INT, 1, MPI_COMM_WORLD);
-                int *buf;
-                int *mass_count;
-                int *mass_disp;
-                if (iteration % 2 == 0) {
-                	MPI_Gatherv(&even_table[width], (height - 2) * width, MPI_CHAR, buf, mass_count, mass_disp, MPI_CHAR, 0, MPI_COMM_WORLD);
-                } else {
-        	    	MPI_Gatherv(&odd_table[width], (height - 2) * width, MPI_CHAR, buf, mass_count, mass_disp, MPI_CHAR, 0, MPI_COMM_WORLD);
-                }
-            } else if (message == ITERATION) {
-                MPI_Bcast(&iteration, 1, MPI_INT, 1, MPI_COMM_WORLD);
-            } else if (message == TIME) {
-                if (st) {
-                    std::cerr << "The game is still running. Stop it or wait till the end" << std::endl;
-                } else {
-                    std::cout << "The time is " << stop_time - start_time << " sec"  << std::endl;
+            }
+        } else if (!running || iteration % check_every == 0) {
+            if (!running) {
+                finish_status(output, rank);
+            }
+            double idle_start = MPI_Wtime();
+            if (rank == 0) {
+                read_command(c, running, m, cmd);
+            }
+            MPI_Bcast(&cmd.message, 1, MPI_INT, 0, control_comm);
+            perf.idle += MPI_Wtime() - idle_start;
+            if (!running) {
+                add_trace("idle", idle_start, MPI_Wtime(), -1);
+            }
+            if (cmd.message != WAIT && cmd.message != RUN) { // the board of a STATUS comes first
+                finish_status(output, rank);
+            }
+        }
+        if (cmd.message == START) {
+            std::string name;
+            int format;
+            if (batch) {
+                name = batch_input;
+                format = batch_format(name);
+                life_rule board_rule = rule;
+                int height, width;
+                if ((format == CHECKPOINT_BOARD || rule.radius > 1) && read_board_size(name, format, height, width, board_rule)
+                    && !board_fits_rule(board_rule, height, width, size)) {
+                    board_error("The board is too small for the radius of the rule");
                 }
+            } else if (rank == 0) {
+                name = cmd.name;
+                format = cmd.format;
+                send_board_name(name, cmd.format);
+            } else {
+                name = receive_board_name(format);
             }
-            MPI_Ibcast(&message, 1, MPI_INT, 0, MPI_COMM_WORLD, &request); 
-        } 
-        if (iteration < it_count) {
-            send_borders(iteration % 2 ? odd_table : even_table, rank, size, height, width);
-            iterate(iteration % 2 ? odd_table : even_table, iteration % 2 ? even_table : odd_table, height, width);
-            iteration++;
-        } else {
+            if (!batch) {
+                MPI_Bcast(&rule, sizeof(rule), MPI_BYTE, 0, control_comm);
+            }
+            iteration = it_count = init_table(even_table, g, MPI_COMM_WORLD, name, format, cmd.random);
+            if (rank == 0) {
+                m.board.height = g.height;
+                m.board.width = g.width;
+            }
+            select_rule(rule);
+            copy_table(odd_table, even_table);
+            init_activity(act, even_table);
+            reset_cycle_watch(cycle);
+            phase = 0;
+            busy = 0;
+            balance_at = iteration + balance_every;
+            started = true;
+            if (batch) {
+                it_count = iteration + std::min(batch_generations, (long long)INT_MAX - iteration);
+                MPI_Barrier(g.comm); // the snapshots are opened by all
+            }
+        } else if (cmd.message == RUN) {
+            st = RUN;
+            start_time = MPI_Wtime();
+            MPI_Bcast(&cmd.count, 1, MPI_INT, 0, control_comm);
+            it_count += cmd.count;
+        } else if (cmd.message == QUIT) {
+            if (!trace_file.empty()) {
+                write_trace(rank, size);
+            }
+            break;
+        } else if (cmd.message == STOP) {
             if (st == RUN) {
-                stop_time = MPI_Wtime();
                 st = WAIT;
+                it_count = iteration;
+                stop_time = MPI_Wtime();
+            }
+            if (rank == 0) {
+                std::cout << "Iteration: " << iteration << std::endl;
+            }
+        } else if (cmd.message == STATUS) {
+            MPI_Bcast(&cmd.view, sizeof(status_view) / sizeof(int), MPI_INT, 0, control_comm);
+            if (cmd.view.mode == STATUS_BOARD) {
+                start_status(output, iteration % 2 ? odd_table : even_table, g, iteration, cycle.period, size);
+            } else {
+                print_view(iteration % 2 ? odd_table : even_table, g, iteration, cmd.view, snapshot, size);
+            }
+        } else if (cmd.message == SAVE || cmd.message == LOAD) {
+            int format;
+            if (rank == 0) {
+                send_board_name(cmd.name, NO_BOARD);
+            } else {
+                cmd.name = receive_board_name(format);
+            }
+            if (cmd.message == SAVE) {
+                save_checkpoint(iteration % 2 ? odd_table : even_table, g, cmd.name, iteration);
+            } else {
+                iteration = it_count = load_checkpoint(even_table, odd_table, g, cmd.name);
+                init_activity(act, even_table);
+                reset_cycle_watch(cycle);
+                phase = 0;
+                busy = 0;
+                balance_at = iteration + balance_every;
+            }
+        } else if (cmd.message == STATS) {
+            print_stats(rank, size);
+        } else if (cmd.message == TIME) {
+            if (st) {
+                std::cerr << "The game is still running. Stop it or wait till the end" << std::endl;
+            } else {
+                std::cout << "The time is " << stop_time - start_time << " sec"  << std::endl;
+                if (rank == 0 && cycle.period) {
+                    std::cout << "The board repeats every " << cycle.period << " generations since iteration " << cycle.found_at
+                              << ", " << cycle.skipped << " generations skipped" << std::endl;
+                }
+            }
+        }
+        if (started && iteration < it_count) {
+            bit_table& table = iteration % 2 ? odd_table : even_table;
+            int skip = cycle_skip(cycle, std::min(std::min(it_count - iteration, generations_to(iteration, checkpoint_every)),
+                                                  batch ? generations_to(iteration, snapshot_every) : INT_MAX));
+            if (skip > 0) { // the board comes back after them, ghost rows and all
+                cycle.skipped += skip;
+                iteration += skip;
+            } else {
+                if (balance_every > 0 && phase == 0 && iteration >= balance_at && !extended_rule(rule)) { // the ghost rows are exchanged next
+                    if (balance_rows(table, g, busy)) {
+                        copy_table(iteration % 2 ? even_table : odd_table, table);
+                        init_activity(act, table);
+                    }
+                    busy = 0;
+                    balance_at = iteration + balance_every;
+                }
+                int generations = 1;
+                if (phase == 0 && table.halo > 1 && band_rows != 0 && !extended_rule(rule) && mostly_active(act)) {
+                    generations = std::min(table.halo, it_count - iteration);
+                    generations = std::min(generations, generations_to(iteration, checkpoint_every));
+                    generations = std::min(generations, batch ? generations_to(iteration, snapshot_every) : generations_to(iteration, check_every));
+                    generations = std::min(generations, watched_generations(cycle, iteration));
+                }
+                double step_start = MPI_Wtime();
+                double waited = phase == 0 ? step_generations(table, iteration % 2 ? even_table : odd_table, g, generations, act)
+                                           : step(table, iteration % 2 ? even_table : odd_table, g, phase, act);
+                double step_end = MPI_Wtime();
+                busy += step_end - step_start - waited;
+                perf.compute += step_end - step_start - waited;
+                perf.border_wait += waited;
+                perf.run += step_end - step_start;
+                perf.generations += generations;
+                perf.cells += (double)(table.height - 2 * table.halo) * table.width * generations;
+                add_trace("generation", step_start, step_end, iteration);
+                phase = (phase + generations) % (table.halo / rule.radius);
+                iteration += generations;
+                watch_cycle(cycle, iteration % 2 ? odd_table : even_table, g, iteration);
+            }
+            poll_status(output, rank);
+            if (checkpoint_every > 0 && iteration % checkpoint_every == 0) {
+                finish_status(output, rank);
+                save_checkpoint(iteration % 2 ? odd_table : even_table, g, checkpoint_file, iteration);
             }
+            if (batch && iteration < it_count && snapshot_every > 0 && iteration % snapshot_every == 0) {
+                save_checkpoint(iteration % 2 ? odd_table : even_table, g, snapshot_name(iteration), iteration);
+            }
+        }
+    }
+    if (batch) {
+        double seconds = MPI_Wtime() - batch_start;
+        save_checkpoint(iteration % 2 ? odd_table : even_table, g, snapshot_name(iteration), iteration);
+        if (rank == 0) {
+            std::cout << "Iteration: " << iteration << std::endl;
+            std::cout << "The time is " << seconds << " sec" << std::endl;
         }
     }
+    if (reader.joinable()) {
+        reader.join();
+    }
 }
 
+#ifndef LIFE_NO_MAIN // life_bench brings its own
 int main(int argc, char **argv) {
     int rank, size;
-    MPI_Comm comm;
-    int status = MPI_Init(&argc, &argv);
+    int provided;
+    int status = MPI_Init_thread(&argc, &argv, MPI_THREAD_FUNNELED, &provided); // only the main thread of a rank calls MPI
     MPI_Comm_size(MPI_COMM_WORLD, &size);
     MPI_Comm_rank(MPI_COMM_WORLD, &rank);
-    if (size < 2) {
-        MPI_Abort(MPI_COMM_WORLD, 1);
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if ((arg == "-t" || arg == "--threads") && i + 1 < argc) {
+            thread_count = atoi(argv[++i]);
+        } else if (arg == "--halo" && i + 1 < argc) {
+            halo_depth = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--no-skip") {
+            skip_tiles = false;
+        } else if (arg == "--band-rows" && i + 1 < argc) {
+            band_rows = std::max(-1, atoi(argv[++i]));
+        } else if (arg == "--cycle-every" && i + 1 < argc) {
+            cycle_every = std::max(0, atoi(argv[++i]));
+        } else if (arg == "--balance-every" && i + 1 < argc) {
+            balance_every = std::max(0, atoi(argv[++i]));
+        } else if (arg == "--balance-threshold" && i + 1 < argc) {
+            balance_threshold = std::max(0.0, atof(argv[++i]));
+        } else if (arg == "--check-every" && i + 1 < argc) {
+            check_every = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--checkpoint-every" && i + 1 < argc) {
+            checkpoint_every = std::max(0, atoi(argv[++i]));
+        } else if (arg == "--checkpoint-file" && i + 1 < argc) {
+            checkpoint_file = argv[++i];
+        } else if (arg == "--input" && i + 1 < argc) {
+            batch_input = argv[++i];
+        } else if (arg == "--generations" && i + 1 < argc) {
+            batch_generations = std::max(0LL, atoll(argv[++i]));
+        } else if (arg == "--snapshot-every" && i + 1 < argc) {
+            snapshot_every = std::max(0, atoi(argv[++i]));
+        } else if (arg == "--output" && i + 1 < argc) {
+            batch_output = argv[++i];
+        } else if (arg == "--trace" && i + 1 < argc) {
+            trace_file = argv[++i];
+        } else if (arg == "--rule" && i + 1 < argc) {
+            life_rule r;
+            if (parse_rule(argv[++i], r)) {
+                rule = r;
+            } else if (rank == 0) {
+                std::cerr << "Incorrect rule " << argv[i] << std::endl;
+            }
+        } else if (arg == "--hash-nodes" && i + 1 < argc) {
+            hash_node_limit = std::max(1024L, atol(argv[++i]));
+        } else if (rank == 0) {
+            std::cerr << "Unknown argument " << arg << std::endl;
+        }
     }
-    if (rank == 0) {
-        master(size);
-    } else {
-        worker(rank, size);
+    if (thread_count < 1) {
+        thread_count = 1;
+    }
+#ifndef _OPENMP
+    if (thread_count > 1 && rank == 0) {
+        std::cerr << "Built without OpenMP, running one thread per rank" << std::endl;
+    }
+    thread_count = 1;
+#endif
+    if (thread_count > 1 && provided < MPI_THREAD_FUNNELED) {
+        if (rank == 0) {
+            std::cerr << "MPI library has no thread support, running one thread per rank" << std::endl;
+        }
+        thread_count = 1;
     }
+    select_life_row();
+    MPI_Comm_dup(MPI_COMM_WORLD, &control_comm);
+    MPI_Barrier(control_comm);
+    trace_origin = MPI_Wtime();
+    game(rank, size);
+    free_border_plans();
+    MPI_Comm_free(&control_comm);
     MPI_Finalize();
     return 0;
 }
+#endif
@@ -0,0 +1,124 @@
+#ifndef BOARD_MEMORY_H
+#define BOARD_MEMORY_H
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <new>
+
+// Memory of the boards. Every board is one block that starts on a cache line.
+// Blocks of a huge page or more are mapped on huge page boundaries and get
+// transparent huge pages, LIFE_HUGE_PAGES=explicit maps them from the huge
+// page pool instead, falling back to transparent ones when the pool is empty,
+// LIFE_HUGE_PAGES=off keeps the normal pages.
+// The cells are not zeroed by the allocation: a page lands on the NUMA node
+// of the thread that writes it first, so the tables are filled by the threads
+// that compute their rows.
+
+const size_t CACHE_LINE_BYTES = 64;
+const size_t HUGE_PAGE_BYTES = 2 << 20;
+
+enum huge_page_mode {HUGE_PAGES_OFF, HUGE_PAGES_TRANSPARENT, HUGE_PAGES_EXPLICIT};
+
+inline int board_huge_pages() {
+    static int mode = -1;
+    if (mode < 0) {
+        const char *name = getenv("LIFE_HUGE_PAGES");
+        mode = !name ? HUGE_PAGES_TRANSPARENT : !strcmp(name, "off") ? HUGE_PAGES_OFF : !strcmp(name, "explicit") ? HUGE_PAGES_EXPLICIT : HUGE_PAGES_TRANSPARENT;
+    }
+    return mode;
+}
+
+inline size_t board_mapping_bytes(size_t bytes) {
+    return (bytes + HUGE_PAGE_BYTES - 1) / HUGE_PAGE_BYTES * HUGE_PAGE_BYTES;
+}
+
+inline void *alloc_board_memory(size_t bytes) {
+    if (bytes < HUGE_PAGE_BYTES || board_huge_pages() == HUGE_PAGES_OFF) {
+        void *memory;
+        if (posix_memalign(&memory, CACHE_LINE_BYTES, bytes ? bytes : 1)) {
+            throw std::bad_alloc();
+        }
+        return memory;
+    }
+    size_t size = board_mapping_bytes(bytes);
+#ifdef MAP_HUGETLB
+    if (board_huge_pages() == HUGE_PAGES_EXPLICIT) {
+        void *memory = mmap(0, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (memory != MAP_FAILED) {
+            return memory;
+        }
+    }
+#endif
+    // One huge page more than needed, the ends up to the huge page boundaries
+    // are unmapped.
+    char *mapping = (char *)mmap(0, size + HUGE_PAGE_BYTES, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapping == MAP_FAILED) {
+        throw std::bad_alloc();
+    }
+    size_t head = (HUGE_PAGE_BYTES - (size_t)mapping % HUGE_PAGE_BYTES) % HUGE_PAGE_BYTES;
+    if (head) {
+        munmap(mapping, head);
+    }
+    munmap(mapping + head + size, HUGE_PAGE_BYTES - head);
+#ifdef MADV_HUGEPAGE
+    madvise(mapping + head, size, MADV_HUGEPAGE);
+#endif
+    return mapping + head;
+}
+
+inline void free_board_memory(void *memory, size_t bytes) {
+    if (bytes < HUGE_PAGE_BYTES || board_huge_pages() == HUGE_PAGES_OFF) {
+        free(memory);
+    } else {
+        munmap(memory, board_mapping_bytes(bytes));
+    }
+}
+
+// Allocator of the vectors of a board. resize() leaves the new cells as
+// they are, so the first write to them is the one that fills the table.
+template <typename T>
+struct board_allocator {
+    typedef T value_type;
+
+    board_allocator() {}
+
+    template <typename U>
+    board_allocator(const board_allocator<U>&) {}
+
+    T *allocate(size_t count) {
+        return (T *)alloc_board_memory(count * sizeof(T));
+    }
+
+    void deallocate(T *memory, size_t count) {
+        free_board_memory(memory, count * sizeof(T));
+    }
+
+    template <typename U>
+    void construct(U *p) {
+        ::new((void *)p) U;
+    }
+
+    template <typename U, typename... Args>
+    void construct(U *p, Args&&... args) {
+        ::new((void *)p) U(static_cast<Args&&>(args)...);
+    }
+
+    template <typename U>
+    struct rebind {
+        typedef board_allocator<U> other;
+    };
+};
+
+template <typename T, typename U>
+bool operator==(const board_allocator<T>&, const board_allocator<U>&) {
+    return true;
+}
+
+template <typename T, typename U>
+bool operator!=(const board_allocator<T>&, const board_allocator<U>&) {
+    return false;
+}
+
+#endif
@@ -0,0 +1,107 @@
+// Benchmark of one generation of a block: the row kernel, the tiles skipped
+// and the copies of the ghost cells of a block that wraps onto itself, as a
+// worker with a 1 x 1 grid runs them, on one thread. Prints a CSV line per
+// board size and density:
+//   life_bench --size 1024x1024 --size 4096x4096 --density 0.05 --density 0.5
+// LIFE_KERNEL=scalar|sse2|avx2|avx512 picks the row kernel, as for the game,
+// --rule B36/S23 the rule, so a rule with kernels of its own can be compared
+// with Life and with the lookup table kernels of the other rules. Generations
+// and Larger than Life rules, as --rule R5,C0,M1,S34..58,B34..45,NM, run on
+// the lattice engine, whose cost per cell should not grow with the radius.
+// --halo N runs N generations per exchange of the ghost rows, in the bands of
+// the temporal blocking unless --band-rows 0.
+#define LIFE_NO_MAIN
+#include "Life.cpp"
+
+struct bench_board {
+    int height;
+    int width;
+};
+
+// Live cells drawn with the given density, the same board for the same seed.
+void fill_random(bit_table& table, double density, unsigned seed) {
+    random_board r = {table.height - 2 * table.halo, table.width, density, seed};
+    fill_random_rows(table, r, table.halo, r.height, 0, 0);
+}
+
+void bench(const char *kernel, const bench_board& board, double density, int generations, int halo, unsigned seed) {
+    bit_table table;
+    halo *= rule.radius;
+    resize_table(table, board.height + 2 * halo, board.width);
+    table.halo = halo;
+    init_ages(table);
+    fill_random(table, density, seed);
+    bit_table next_table = table;
+    grid g;
+    int dims[2] = {1, 1};
+    create_grid(g, MPI_COMM_SELF, dims, board.height, table.row_words);
+    g.height = board.height;
+    g.width = board.width;
+    g.row_begin = 0;
+    g.word_begin = 0;
+    activity act;
+    init_activity(act, table);
+    step(table, next_table, g, 0, act); // warms the caches and the tiles up
+    double start = MPI_Wtime();
+    for (int i = 0, pass = 1; i < generations; i += pass) {
+        pass = band_rows != 0 && !extended_rule(rule) && mostly_active(act) ? std::min(halo, generations - i) : 1;
+        step_generations(i % 2 ? table : next_table, i % 2 ? next_table : table, g, pass, act);
+    }
+    double seconds = MPI_Wtime() - start;
+    double cells = (double)board.height * board.width;
+    double bytes = 2.0 * (table.words.size() + table.west.size() + table.east.size()) * sizeof(uint64_t) + 2.0 * table.age.size();
+    printf("%s,\"%s\",%d,%d,%g,%d,%d,%d,%.6f,%.4g,%.4f\n", kernel, rule_name(rule).c_str(), board.height, board.width, density, generations, skip_tiles ? 1 : 0, halo,
+           seconds, seconds > 0 ? cells * generations / seconds : 0.0, bytes / cells);
+    free_border_plans();
+    MPI_Type_free(&g.column);
+    MPI_Comm_free(&g.comm);
+}
+
+int main(int argc, char **argv) {
+    MPI_Init(&argc, &argv);
+    std::vector<bench_board> boards;
+    std::vector<double> densities;
+    int generations = 100;
+    int halo = 1;
+    unsigned seed = 1;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        bench_board board;
+        if (arg == "--size" && i + 1 < argc && sscanf(argv[++i], "%dx%d", &board.height, &board.width) == 2 && board.height > 0 && board.width > 0) {
+            boards.push_back(board);
+        } else if (arg == "--density" && i + 1 < argc) {
+            densities.push_back(atof(argv[++i]));
+        } else if (arg == "--generations" && i + 1 < argc) {
+            generations = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--seed" && i + 1 < argc) {
+            seed = strtoul(argv[++i], 0, 10);
+        } else if (arg == "--rule" && i + 1 < argc && parse_rule(argv[++i], rule)) {
+            continue;
+        } else if (arg == "--halo" && i + 1 < argc) {
+            halo = std::max(1, atoi(argv[++i]));
+        } else if (arg == "--band-rows" && i + 1 < argc) {
+            band_rows = std::max(-1, atoi(argv[++i]));
+        } else if (arg == "--no-skip") {
+            skip_tiles = false;
+        } else {
+            std::cerr << "Usage: life_bench [--size HxW]... [--density D]... [--generations N] [--seed S] [--rule B3/S23] [--halo N] [--band-rows N] [--no-skip]" << std::endl;
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+    }
+    if (boards.empty()) {
+        bench_board board = {1024, 1024};
+        boards.push_back(board);
+    }
+    if (densities.empty()) {
+        densities.push_back(0.5);
+    }
+    const char *kernel = select_life_row();
+    printf("kernel,rule,height,width,density,generations,skip,halo,seconds,cell_updates_per_s,bytes_per_cell\n");
+    for (size_t b = 0; b < boards.size(); ++b) {
+        for (size_t d = 0; d < densities.size(); ++d) {
+            bench(kernel, boards[b], densities[d], generations, halo, seed);
+        }
+    }
+    MPI_Finalize();
+    return 0;
+}
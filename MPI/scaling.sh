@@ -0,0 +1,60 @@
+#!/bin/bash
+# Strong and weak scaling of the game: runs a random board for a number of
+# generations on each rank count and prints a CSV line per run, from the
+# STATS of the ranks. Strong scaling keeps the board, weak scaling gives
+# every rank the same rows, HxW per rank stacked from top to bottom.
+#   scaling.sh [-b life] [-r "1 2 4 8"] [-g generations] [-s HxW] [-m strong|weak|both] [-- life arguments]
+# MPIRUN overrides the launcher, e.g. MPIRUN="mpirun --oversubscribe".
+
+binary=./life
+ranks="1 2 4 8"
+generations=200
+size=1024x1024
+mode=both
+while getopts "b:r:g:s:m:" option; do
+    case $option in
+        b) binary=$OPTARG ;;
+        r) ranks=$OPTARG ;;
+        g) generations=$OPTARG ;;
+        s) size=$OPTARG ;;
+        m) mode=$OPTARG ;;
+        *) sed -n 6p "$0" >&2; exit 1 ;;
+    esac
+done
+shift $((OPTIND - 1))
+height=${size%x*}
+width=${size#*x}
+mpirun=${MPIRUN:-mpirun}
+
+# run MODE RANKS HEIGHT WIDTH [life arguments]: the CSV line of one run,
+# without the efficiency
+run() {
+    local m=$1 r=$2 h=$3 w=$4
+    shift 4
+    printf "START %d %d\nRUN %d\nSTATS\nQUIT\n" "$h" "$w" "$generations" |
+        $mpirun -np "$r" "$binary" "$@" 2>/dev/null |
+        awk -v mode="$m" -v ranks="$r" -v height="$h" -v width="$w" -v generations="$generations" '
+            /^generations\/s:/ { rate = $2 } # the slowest rank sets the pace
+            /^total cell updates\/s:/ { cells = $4 }
+            END {
+                if (rate > 0) {
+                    printf "%s,%d,%d,%d,%d,%.6f,%.2f,%.4g\n", mode, ranks, height, width, generations, generations / rate, rate, cells
+                }
+            }'
+}
+
+echo "mode,ranks,height,width,generations,seconds,generations_per_s,cell_updates_per_s,efficiency"
+for m in strong weak; do
+    if [ "$mode" != both ] && [ "$mode" != $m ]; then
+        continue
+    fi
+    for r in $ranks; do
+        h=$height
+        if [ $m = weak ]; then
+            h=$((height * r))
+        fi
+        run $m "$r" "$h" "$width" "$@"
+    done |
+        # efficiency against the first rank count: cell updates per rank
+        awk -F, '{ per_rank = $8 / $2; if (NR == 1) base = per_rank; printf "%s,%.3f\n", $0, (base > 0 ? per_rank / base : 0) }'
+done
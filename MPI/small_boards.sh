@@ -0,0 +1,37 @@
+#!/bin/bash
+# Boards with fewer rows or columns than the ranks have: every one must run
+# to the same board as on one rank, and a rule whose radius does not fit the
+# board must be turned down without ending the game.
+#   small_boards.sh [life]
+# MPIRUN overrides the launcher, e.g. MPIRUN="mpirun --oversubscribe".
+
+binary=${1:-./life}
+mpirun=${MPIRUN:-mpirun}
+failed=0
+
+# board RANKS HEIGHT WIDTH RULE: the STATUS of a random board after a few
+# generations
+board() {
+    printf "START %d %d 0.5 7 RULE %s\nRUN 5\nTIME\nSTATUS\nQUIT\n" "$2" "$3" "$4" |
+        $mpirun -np "$1" "$binary" 2>&1 | grep -E '^(Iteration|[01] )'
+}
+
+for rule in B3/S23 B2/S/C3; do
+    for run in "1 1 1" "1 2 2" "4 3 5" "2 5 2" "6 3 70" "8 2 130"; do
+        set -- $run
+        expected=$(board 1 "$2" "$3" $rule)
+        got=$(board "$1" "$2" "$3" $rule)
+        if [ -z "$got" ] || [ "$got" != "$expected" ]; then
+            echo "FAIL: START $2 $3 RULE $rule on $1 ranks"
+            failed=1
+        fi
+    done
+done
+
+reply=$(printf "START 4 9 RULE R2,C0,M1,S3..5,B3..4,NM\nSTART 4 9\nRUN 1\nTIME\nSTATUS\nQUIT\n" |
+    $mpirun -np 2 "$binary" 2>&1)
+if ! echo "$reply" | grep -q "too small for the radius of the rule. Try again" || ! echo "$reply" | grep -q "^Iteration: 1"; then
+    echo "FAIL: a radius 2 rule on 4 rows of 2 ranks"
+    failed=1
+fi
+exit $failed